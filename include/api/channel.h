@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_CHANNEL_H_
+#define API_CHANNEL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <api/waker.h>
+
+namespace api {
+
+/**
+ * Hands out the items of a list result while the response is still being
+ * decoded.
+ *
+ * Items are numbered by their position in the list. Positions that were
+ * already offered are ignored, so a response that ends up being decoded a
+ * second time (e.g. falling back to a cached copy) does not repeat them.
+ *
+ * The producer is the HTTP worker thread shared by all requests, so
+ * offering an item never blocks. The queue is bounded by the list size
+ * that was requested instead. A consumer that waits for more than this
+ * channel passes a Waker, which is notified of each offer and the close.
+ */
+template<typename T>
+class Channel {
+public:
+    typedef std::shared_ptr<Channel<T>> Ptr;
+
+    explicit Channel(const Waker::Ptr &waker = Waker::Ptr()) :
+            waker_(waker) {
+    }
+
+    void offer(std::size_t index, const T &item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_ || index != offered_) {
+                return;
+            }
+            ++offered_;
+            queue_.emplace_back(item);
+            cond_.notify_all();
+        }
+        if (waker_) {
+            waker_->notify();
+        }
+    }
+
+    /**
+     * No more items will be offered
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            cond_.notify_all();
+        }
+        if (waker_) {
+            waker_->notify();
+        }
+    }
+
+    /**
+     * Wait up to @a timeout for items to arrive, and take all that are
+     * queued. Returns straight away once the channel is closed.
+     */
+    template<typename Rep, typename Period>
+    std::deque<T> take(const std::chrono::duration<Rep, Period> &timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, timeout, [this]() {
+            return !queue_.empty() || closed_;
+        });
+        std::deque<T> items;
+        items.swap(queue_);
+        taken_ += items.size();
+        return items;
+    }
+
+    /**
+     * Number of items the consumer has taken so far
+     */
+    std::size_t taken() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return taken_;
+    }
+
+    bool closed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_ && queue_.empty();
+    }
+
+protected:
+    std::deque<T> queue_;
+
+    std::size_t offered_ = 0;
+
+    std::size_t taken_ = 0;
+
+    bool closed_ = false;
+
+    mutable std::mutex mutex_;
+
+    std::condition_variable cond_;
+
+    Waker::Ptr waker_;
+};
+
+}
+
+#endif // API_CHANNEL_H_
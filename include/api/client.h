@@ -20,17 +20,21 @@
 #ifndef API_CLIENT_H_
 #define API_CLIENT_H_
 
+#include <api/channel.h>
 #include <api/config.h>
 #include <api/track.h>
 #include <api/comment.h>
+#include <api/waker.h>
 
 #include <unity/scopes/OnlineAccountClient.h>
 
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <future>
 #include <map>
 #include <string>
+#include <vector>
 #include <core/net/http/request.h>
 #include <core/net/uri.h>
 
@@ -54,25 +58,144 @@ enum class SP {
  */
 class Client {
 public:
-    Client(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client);
+    typedef std::shared_ptr<Client> Ptr;
+
+    /**
+     * Create a client with its own HTTP runtime (worker thread and connections).
+     *
+     * This is expensive, so the scope creates one client at startup and hands
+     * out sessions of it to each query.
+     *
+     * If @a cache_directory is given, GET responses are kept there and
+     * served from disk while they are fresh.
+     */
+    Client(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client,
+           const std::string &cache_directory = std::string());
 
     virtual ~Client() = default;
 
+    /**
+     * Create a client sharing this client's HTTP runtime, but with its own
+     * cancellation state.
+     *
+     * Cancelling the returned session only aborts the requests issued through it.
+     */
+    Client session() const;
 
+
+    typedef Channel<Track>::Ptr TrackChannel;
+
+    /**
+     * The track list methods also offer each track to @a channel as soon
+     * as it is decoded, while the rest of the response is still arriving.
+     * The future still gets the complete list.
+     */
     virtual std::future<std::deque<Track>> search_tracks(
-            const std::deque<std::pair<SP, std::string>> &parameters);
+            const std::deque<std::pair<SP, std::string>> &parameters,
+            const TrackChannel &channel = TrackChannel());
 
-    virtual std::future<std::deque<Track>> stream_tracks(int limit=0);
+    /**
+     * The stream is kept between calls, and only the activities newer
+     * than it are downloaded again
+     */
+    virtual std::future<std::deque<Track>> stream_tracks(int limit=0,
+            const TrackChannel &channel = TrackChannel());
 
     virtual std::future<std::deque<Comment>> track_comments(const std::string &trackid);
 
+    /**
+     * Writes (comments, likes and follows) are queued in a persistent
+     * outbox and sent in the background, retrying on failure. Their
+     * futures report them queued straight away, and the relationship
+     * checks already take queued writes into account. They need a logged
+     * in user, and fail with a domain_error otherwise; once queued, they
+     * wait for the user to log in again if needed.
+     */
     virtual std::future<bool> post_comment(const std::string &trackid,
                                            const std::string &postmsg);
 
-    virtual std::future<std::deque<Track>> favorite_tracks();
+    /**
+     * Whether a comment of the logged in user on @a trackid is still
+     * waiting to be sent. Until it is, track_comments() may not have it.
+     */
+    virtual bool comment_queued(const std::string &trackid);
+
+    /**
+     * Only the first chunk of the favorites, use favorite_track_pages()
+     * for the rest
+     */
+    virtual std::future<std::deque<Track>> favorite_tracks(
+            const TrackChannel &channel = TrackChannel());
 
     virtual std::future<std::deque<Track>> get_user_tracks(const std::string &userid,
-                                                           int limit = 0);
+                                                           int limit = 0,
+                                                           const TrackChannel &channel = TrackChannel());
+
+    /**
+     * Walks a track list page by page, following the API's
+     * linked_partitioning cursors.
+     *
+     * The page after the last one handed out is fetched in the background
+     * as soon as its cursor is known, so asking for it is usually answered
+     * from memory. Tracks that were on an earlier page are left out.
+     */
+    class TrackPager {
+    public:
+        typedef std::shared_ptr<TrackPager> Ptr;
+
+        virtual ~TrackPager() = default;
+
+        /**
+         * The next page, which is empty once the list is exhausted
+         */
+        virtual std::future<std::deque<Track>> next() = 0;
+
+        /**
+         * Whether every page has been handed out
+         */
+        virtual bool exhausted() const = 0;
+    };
+
+    /**
+     * Pagers over the same lists as the track list methods. The pages are
+     * @a limit tracks long (SP::limit for searches), 50 by default.
+     */
+    virtual TrackPager::Ptr search_track_pages(
+            const std::deque<std::pair<SP, std::string>> &parameters);
+
+    virtual TrackPager::Ptr stream_track_pages(int limit = 0);
+
+    virtual TrackPager::Ptr favorite_track_pages(int limit = 0);
+
+    virtual TrackPager::Ptr user_track_pages(const std::string &userid,
+                                             int limit = 0);
+
+    /**
+     * The @a limit hottest tracks of @a genre, ranked locally by their
+     * engagement and age (see hotness()) out of a pool of a few hundred.
+     * The pool is kept between calls and fetched again in the background
+     * when it gets old. Cancelling the session only breaks off the wait
+     * for a pool's first fetch.
+     */
+    virtual std::future<std::deque<Track>> hot_tracks(const std::string &genre,
+                                                      unsigned int limit);
+
+    /**
+     * Tracks looked up by ID
+     */
+    struct TrackLookup {
+        /// In the order they were asked for
+        std::deque<Track> tracks;
+
+        /// IDs the server did not return, e.g. deleted or private tracks
+        std::vector<unsigned int> missing;
+    };
+
+    /**
+     * Look up any number of tracks at once. The IDs are split into
+     * requests of the size the API allows, which all go out together.
+     */
+    virtual std::future<TrackLookup> get_tracks(const std::vector<unsigned int> &ids);
 
     virtual std::future<bool> is_fav_track(const std::string &trackid);
 
@@ -91,19 +214,77 @@ public:
     virtual std::future<User> get_user_info(const std::string &userid);
 
     /**
-     * Cancel any pending queries (this method can be called from a different thread)
+     * Cancel any pending queries of this session (this method can be called
+     * from a different thread)
      */
     virtual void cancel();
 
+    /**
+     * Abort the requests of this session that are still running at
+     * @a deadline, and fail those issued after it (unless a cached copy
+     * can be served). There is no deadline by default.
+     */
+    virtual void set_deadline(const std::chrono::steady_clock::time_point &deadline);
+
+    virtual std::chrono::steady_clock::time_point deadline() const;
+
+    /**
+     * Notify @a waker whenever a request of this session issued from now
+     * on finishes, fails or is aborted, so that one thread can wait for
+     * whichever of several futures is ready first. Results served from the
+     * caches are ready before their future is returned.
+     */
+    virtual void set_waker(const Waker::Ptr &waker);
+
     virtual std::string client_id();
 
     virtual bool authenticated();
 
+    /**
+     * Identifies the logged in user without revealing their credentials,
+     * or is empty if there is none
+     */
+    virtual std::string owner();
+
+    /**
+     * Counters describing the work done, and avoided, by this session
+     */
+    struct Statistics {
+        /// Online accounts lookups performed on behalf of this session
+        unsigned int credential_lookups = 0;
+
+        /// Credential requests answered from the cached snapshot instead
+        unsigned int credential_lookups_saved = 0;
+
+        /// Requests answered from the shared parsed result cache
+        unsigned int result_cache_hits = 0;
+
+        /// Cacheable requests that had to be parsed again
+        unsigned int result_cache_misses = 0;
+
+        /// Memory held by the shared parsed result cache
+        std::size_t result_cache_bytes = 0;
+
+        /// Stale responses the server confirmed unchanged (304)
+        unsigned int revalidated = 0;
+
+        /// Requests that joined an identical one already in flight
+        unsigned int coalesced = 0;
+    };
+
+    virtual Statistics statistics() const;
+
 protected:
     class Priv;
     friend Priv;
 
+    struct Session;
+
+    Client(std::shared_ptr<Priv> priv);
+
     std::shared_ptr<Priv> p;
+
+    std::shared_ptr<Session> session_;
 };
 
 }
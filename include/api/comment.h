@@ -56,6 +56,13 @@ public:
     std::string kind_str() const override;
 
 protected:
+    template<typename> friend struct Schema;
+
+    /**
+     * Tidy up the raw values returned by the server
+     */
+    void normalize();
+
     std::string body_;
 
     std::string created_at_;
@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_DECODER_H_
+#define API_DECODER_H_
+
+#include <api/channel.h>
+#include <api/comment.h>
+#include <api/json_stream.h>
+#include <api/page.h>
+#include <api/track.h>
+#include <api/user.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace api {
+
+/**
+ * Which JSON fields of a resource go into which members.
+ *
+ * Specialized for Track, User and Comment. Fields that are not listed are
+ * skipped, and members whose field is missing keep the value they get from
+ * an empty document.
+ */
+template<typename T>
+struct Schema {
+    struct Field {
+        std::string T::*text;
+
+        unsigned int T::*number;
+
+        bool T::*flag;
+
+        /// An embedded user object
+        User T::*user;
+    };
+
+    static const std::unordered_map<std::string, Field> & fields();
+
+    /**
+     * The value of a resource read from an empty document
+     */
+    static const T & blank();
+
+    /**
+     * Apply the same clean-ups as the Json::Value constructor
+     */
+    static void finish(T &value);
+};
+
+template<>
+const std::unordered_map<std::string, Schema<Track>::Field> & Schema<Track>::fields();
+
+template<>
+const Track & Schema<Track>::blank();
+
+template<>
+void Schema<Track>::finish(Track &value);
+
+template<>
+const std::unordered_map<std::string, Schema<User>::Field> & Schema<User>::fields();
+
+template<>
+const User & Schema<User>::blank();
+
+template<>
+void Schema<User>::finish(User &value);
+
+template<>
+const std::unordered_map<std::string, Schema<Comment>::Field> & Schema<Comment>::fields();
+
+template<>
+const Comment & Schema<Comment>::blank();
+
+template<>
+void Schema<Comment>::finish(Comment &value);
+
+/**
+ * Builds a result of type T from parser events
+ */
+template<typename T>
+class Decoder: public JsonStreamParser::Handler {
+public:
+    typedef std::shared_ptr<Decoder<T>> Ptr;
+
+    typedef std::function<Ptr()> Factory;
+
+    /**
+     * Called once, after the last event. A decoder that has seen no events
+     * returns what an empty (null) document decodes to.
+     */
+    virtual T result() = 0;
+};
+
+/**
+ * Builds the whole Json::Value and hands it to a function, for results
+ * that do not have a schema.
+ */
+template<typename T>
+class ValueDecoder: public Decoder<T> {
+public:
+    ValueDecoder(const std::function<T(const Json::Value &root)> &func) :
+            func_(func) {
+    }
+
+    void start_object() override {
+        builder_.start_object();
+    }
+
+    void end_object() override {
+        builder_.end_object();
+    }
+
+    void start_array() override {
+        builder_.start_array();
+    }
+
+    void end_array() override {
+        builder_.end_array();
+    }
+
+    void key(const std::string &name) override {
+        builder_.key(name);
+    }
+
+    void string_value(const std::string &value) override {
+        builder_.string_value(value);
+    }
+
+    void number_value(const std::string &text) override {
+        builder_.number_value(text);
+    }
+
+    void bool_value(bool value) override {
+        builder_.bool_value(value);
+    }
+
+    void null_value() override {
+        builder_.null_value();
+    }
+
+    T result() override {
+        return func_(builder_.root());
+    }
+
+protected:
+    JsonValueBuilder builder_;
+
+    std::function<T(const Json::Value &root)> func_;
+};
+
+/**
+ * Reads a single resource, and the user embedded in it, from the events
+ * between its opening and closing brace.
+ */
+template<typename T>
+class ResourceReader {
+public:
+    enum class Scalar {
+        string, number, boolean, null
+    };
+
+    /**
+     * Start over with a blank resource, after its opening brace
+     */
+    void begin();
+
+    void key(const std::string &name);
+
+    void scalar(Scalar type, const std::string &text);
+
+    void start_container(bool object);
+
+    /**
+     * @return true once the resource's own closing brace was seen
+     */
+    bool end_container();
+
+    T & value();
+
+    /**
+     * The resource's "kind" field
+     */
+    const std::string & kind() const;
+
+protected:
+    T value_ = Schema<T>::blank();
+
+    std::string kind_;
+
+    /// Containers open inside the resource
+    unsigned int depth_ = 0;
+
+    const typename Schema<T>::Field *field_ = nullptr;
+
+    bool kind_field_ = false;
+
+    /// Set while inside the embedded user object
+    User *user_ = nullptr;
+
+    const typename Schema<User>::Field *user_field_ = nullptr;
+};
+
+/**
+ * Shared plumbing for decoders built on a ResourceReader
+ */
+template<typename T, typename R>
+class ResourceDecoder: public Decoder<R> {
+public:
+    void start_object() override;
+
+    void end_object() override;
+
+    void start_array() override;
+
+    void end_array() override;
+
+    void key(const std::string &name) override;
+
+    void string_value(const std::string &value) override;
+
+    void number_value(const std::string &text) override;
+
+    void bool_value(bool value) override;
+
+    void null_value() override;
+
+protected:
+    typedef typename ResourceReader<T>::Scalar Scalar;
+
+    /**
+     * Events outside of a resource. Return true from container() when
+     * the object that was just opened is a resource to read.
+     */
+    virtual bool container(bool object) = 0;
+
+    virtual void container_end() {
+    }
+
+    virtual void outer_key(const std::string &) {
+    }
+
+    virtual void outer_scalar(Scalar, const std::string &) {
+    }
+
+    /**
+     * A resource has been read completely
+     */
+    virtual void resource(T &value, const std::string &kind) = 0;
+
+    ResourceReader<T> reader_;
+
+    bool reading_ = false;
+
+    /// Containers open outside of the resource being read
+    unsigned int depth_ = 0;
+};
+
+/**
+ * Decodes a top-level array, or the "collection" array of a
+ * linked_partitioning page, keeping the items of the given kind
+ */
+template<typename T>
+class ListDecoder: public ResourceDecoder<T, std::deque<T>> {
+public:
+    typedef std::function<bool(const T&, const T&)> Order;
+
+    /**
+     * @param order if set, the list is stable sorted with it
+     * @param channel if set, receives the items as soon as they are decoded
+     *        (or once sorted), and is closed at the end of the document
+     */
+    ListDecoder(const std::string &kind, const Order &order = Order(),
+                const typename Channel<T>::Ptr &channel = typename Channel<T>::Ptr());
+
+    std::deque<T> result() override;
+
+protected:
+    bool container(bool object) override;
+
+    void container_end() override;
+
+    void outer_key(const std::string &name) override;
+
+    void resource(T &value, const std::string &kind) override;
+
+    std::string kind_;
+
+    Order order_;
+
+    typename Channel<T>::Ptr channel_;
+
+    bool root_array_ = false;
+
+    std::string key_;
+
+    bool in_collection_ = false;
+
+    std::deque<T> results_;
+};
+
+/**
+ * Decodes the "origin" of the activities of the given type in a
+ * { "collection": [ ... ] } document
+ */
+template<typename T>
+class ActivityListDecoder: public ResourceDecoder<T, std::deque<T>> {
+public:
+    typedef typename ResourceDecoder<T, std::deque<T>>::Scalar Scalar;
+
+    ActivityListDecoder(const std::string &type,
+                        const typename Channel<T>::Ptr &channel = typename Channel<T>::Ptr());
+
+    std::deque<T> result() override;
+
+protected:
+    bool container(bool object) override;
+
+    void container_end() override;
+
+    void outer_key(const std::string &name) override;
+
+    void outer_scalar(Scalar type, const std::string &text) override;
+
+    void resource(T &value, const std::string &kind) override;
+
+    std::string type_;
+
+    typename Channel<T>::Ptr channel_;
+
+    std::string key_;
+
+    bool in_collection_ = false;
+
+    std::string activity_type_;
+
+    T origin_ = Schema<T>::blank();
+
+    bool has_origin_ = false;
+
+    std::deque<T> results_;
+};
+
+/**
+ * Decodes a page of a list: the items with @a items (a ListDecoder or an
+ * ActivityListDecoder, which see all the events), and the cursors itself.
+ */
+template<typename T>
+class PageDecoder: public Decoder<Page<T>> {
+public:
+    PageDecoder(const typename Decoder<std::deque<T>>::Ptr &items);
+
+    void start_object() override;
+
+    void end_object() override;
+
+    void start_array() override;
+
+    void end_array() override;
+
+    void key(const std::string &name) override;
+
+    void string_value(const std::string &value) override;
+
+    void number_value(const std::string &text) override;
+
+    void bool_value(bool value) override;
+
+    void null_value() override;
+
+    Page<T> result() override;
+
+protected:
+    typename Decoder<std::deque<T>>::Ptr items_;
+
+    /// Containers open
+    unsigned int depth_ = 0;
+
+    std::string key_;
+
+    Page<T> page_;
+};
+
+/**
+ * Decodes a top-level object, if it is of the given kind
+ */
+template<typename T>
+class ObjectDecoder: public ResourceDecoder<T, T> {
+public:
+    ObjectDecoder(const std::string &kind);
+
+    T result() override;
+
+protected:
+    bool container(bool object) override;
+
+    void resource(T &value, const std::string &kind) override;
+
+    std::string kind_;
+
+    T value_ = Schema<T>::blank();
+};
+
+}
+
+#endif // API_DECODER_H_
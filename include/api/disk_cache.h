@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_DISK_CACHE_H_
+#define API_DISK_CACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace api {
+
+/**
+ * A size-bounded, persistent store of raw HTTP response bodies.
+ *
+ * Each entry lives in its own file, named after a digest of its key.
+ * Entries are written to a temporary file and renamed into place, and
+ * carry a checksum of their body, so a crash can at worst lose an entry,
+ * never hand back a truncated one. When the cache grows past its size
+ * limit the least recently used entries are removed.
+ *
+ * All methods can be called from any thread.
+ */
+class DiskCache {
+public:
+    typedef std::shared_ptr<DiskCache> Ptr;
+
+    typedef std::chrono::system_clock Clock;
+
+    struct Entry {
+        /// The response body exactly as it was received (usually gzipped)
+        std::string body;
+
+        /// Validators for conditional requests, empty if the server sent none
+        std::string etag;
+
+        std::string last_modified;
+
+        Clock::time_point stored;
+
+        Clock::time_point expiry;
+
+        bool fresh() const;
+    };
+
+    /**
+     * Open (and create if needed) a cache in @a directory, holding at
+     * most @a max_size bytes.
+     */
+    DiskCache(const std::string &directory, std::size_t max_size);
+
+    virtual ~DiskCache() = default;
+
+    /**
+     * Look up an entry, whether fresh or stale (stale entries can still be
+     * revalidated). Corrupt entries are removed and reported as missing.
+     */
+    bool get(const std::string &key, Entry &entry);
+
+    void put(const std::string &key, const Entry &entry);
+
+    void remove(const std::string &key);
+
+    /**
+     * Remove every entry whose key starts with @a prefix. The keys are
+     * only kept in the entries, so this reads the head of each of them.
+     */
+    void remove_prefix(const std::string &prefix);
+
+    /**
+     * Total size of the entries on disk, in bytes
+     */
+    std::size_t size() const;
+
+    /**
+     * Stable 64-bit digest of @a data, as 16 hex characters
+     */
+    static std::string digest(const std::string &data);
+
+protected:
+    struct Index {
+        std::size_t size;
+
+        Clock::time_point last_used;
+    };
+
+    std::string path(const std::string &name) const;
+
+    void load_index();
+
+    void erase(const std::string &name);
+
+    void evict(std::size_t needed);
+
+    std::string directory_;
+
+    std::size_t max_size_;
+
+    std::size_t size_ = 0;
+
+    std::map<std::string, Index> index_;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // API_DISK_CACHE_H_
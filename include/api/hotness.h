@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_HOTNESS_H_
+#define API_HOTNESS_H_
+
+#include <api/track.h>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace api {
+
+/**
+ * How hot @a track is at @a now.
+ *
+ * Plays, likes, reposts and comments add up to its engagement, with the
+ * rarer signals weighted higher. The score is the logarithm of that,
+ * minus the track's age: it loses as much as half its engagement would
+ * every week. Scores can only be compared with others taken at the same
+ * @a now.
+ */
+double hotness(const Track &track,
+               const std::chrono::system_clock::time_point &now);
+
+/**
+ * The @a k hottest of @a tracks, hottest first. Tracks that score the
+ * same keep their order.
+ */
+std::deque<Track> hottest(const std::deque<Track> &tracks, std::size_t k,
+                          const std::chrono::system_clock::time_point &now);
+
+/**
+ * The @a k hottest tracks of @a lists, which are each hottest first (as
+ * hottest() returns them), without repeats. The lists are merged through a
+ * heap that only ever holds the next track of each list.
+ */
+std::deque<Track> merge_hottest(const std::vector<std::deque<Track>> &lists,
+                                std::size_t k,
+                                const std::chrono::system_clock::time_point &now);
+
+}
+
+#endif // API_HOTNESS_H_
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_ID_INDEX_H_
+#define API_ID_INDEX_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace api {
+
+/**
+ * A set of resource IDs that belongs to one user, e.g. the tracks they
+ * like, so that membership can be checked without a round-trip.
+ *
+ * The set is synced in full from the server every now and then, and kept
+ * up to date in between by the writes made through the client. Until the
+ * first sync for the current owner finishes, every answer is unknown.
+ *
+ * All methods can be called from any thread.
+ */
+class IdIndex {
+public:
+    typedef std::shared_ptr<IdIndex> Ptr;
+
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Answer {
+        no, yes, unknown
+    };
+
+    /**
+     * @param max_age how long a sync is trusted
+     * @param retry how long to wait after a failed sync
+     */
+    IdIndex(Clock::duration max_age, Clock::duration retry);
+
+    virtual ~IdIndex() = default;
+
+    Answer lookup(const std::string &owner, unsigned int id) const;
+
+    /**
+     * Whether a sync for @a owner is due. Whoever gets true is the only one
+     * syncing, and must follow up with synced() or sync_failed().
+     */
+    bool start_sync(const std::string &owner);
+
+    /**
+     * Replace the set with a sync's result.
+     *
+     * @param complete false if the server may have more IDs than it sent,
+     *        in which case IDs that are not in the set stay unknown
+     */
+    void synced(const std::string &owner, std::vector<unsigned int> ids,
+                bool complete);
+
+    void sync_failed(const std::string &owner);
+
+    /**
+     * Record a write made by @a owner. Writes are applied again on top of
+     * the next sync's result, in case it was served from a cache.
+     */
+    void add(const std::string &owner, unsigned int id);
+
+    void remove(const std::string &owner, unsigned int id);
+
+    std::size_t size() const;
+
+protected:
+    void edit(const std::string &owner, unsigned int id, bool present);
+
+    void apply(unsigned int id, bool present);
+
+    Clock::duration max_age_;
+
+    Clock::duration retry_;
+
+    /// Sorted
+    std::vector<unsigned int> ids_;
+
+    /// Writes since the last sync finished, in order
+    std::vector<std::pair<unsigned int, bool>> edits_;
+
+    std::string owner_;
+
+    bool known_ = false;
+
+    bool complete_ = false;
+
+    bool syncing_ = false;
+
+    Clock::time_point next_sync_;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // API_ID_INDEX_H_
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_JSON_STREAM_H_
+#define API_JSON_STREAM_H_
+
+#include <json/json.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace api {
+
+/**
+ * An incremental, event based JSON parser.
+ *
+ * The document can be fed in arbitrarily sized chunks as it arrives, and
+ * each element is reported to the Handler as soon as it is complete, so
+ * the whole text never has to be held in memory.
+ *
+ * Syntax errors are reported as std::domain_error.
+ */
+class JsonStreamParser {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        virtual void start_object() = 0;
+
+        virtual void end_object() = 0;
+
+        virtual void start_array() = 0;
+
+        virtual void end_array() = 0;
+
+        virtual void key(const std::string &name) = 0;
+
+        virtual void string_value(const std::string &value) = 0;
+
+        /**
+         * @a text is the number exactly as written in the document
+         */
+        virtual void number_value(const std::string &text) = 0;
+
+        virtual void bool_value(bool value) = 0;
+
+        virtual void null_value() = 0;
+    };
+
+    JsonStreamParser(Handler &handler);
+
+    virtual ~JsonStreamParser() = default;
+
+    void feed(const char *data, std::size_t size);
+
+    /**
+     * Signal the end of the document, which must be complete by now
+     */
+    void finish();
+
+protected:
+    enum class Lexeme {
+        none, string, escape, unicode, number, literal
+    };
+
+    enum class Expect {
+        value, value_or_end, key, key_or_end, colon, comma_or_end, done
+    };
+
+    void punctuation(char c);
+
+    void begin_value();
+
+    void end_value();
+
+    void end_string();
+
+    void end_number();
+
+    void end_literal();
+
+    void append_code_unit(std::uint32_t unit);
+
+    void append_utf8(std::uint32_t code_point);
+
+    void error(const std::string &what) const;
+
+    Handler &handler_;
+
+    Lexeme lexeme_ = Lexeme::none;
+
+    Expect expect_ = Expect::value;
+
+    /// Open containers, '{' or '['
+    std::vector<char> containers_;
+
+    std::string token_;
+
+    unsigned int unicode_digits_ = 0;
+
+    std::uint32_t code_unit_ = 0;
+
+    std::uint32_t high_surrogate_ = 0;
+
+    std::size_t offset_ = 0;
+};
+
+/**
+ * Builds a Json::Value out of the parser events
+ */
+class JsonValueBuilder: public JsonStreamParser::Handler {
+public:
+    void start_object() override;
+
+    void end_object() override;
+
+    void start_array() override;
+
+    void end_array() override;
+
+    void key(const std::string &name) override;
+
+    void string_value(const std::string &value) override;
+
+    void number_value(const std::string &text) override;
+
+    void bool_value(bool value) override;
+
+    void null_value() override;
+
+    Json::Value & root();
+
+protected:
+    Json::Value & add(Json::ValueType type);
+
+    Json::Value root_;
+
+    std::vector<Json::Value *> stack_;
+
+    std::string key_;
+};
+
+/**
+ * Inflates a gzipped JSON document as it arrives, feeding the parser.
+ *
+ * Decompression errors, including a body that is not gzipped at all, are
+ * thrown as boost::iostreams::gzip_error by write() or close(). A
+ * malformed document is not an error, the handler just stops receiving
+ * events and malformed() is set, matching how Json::Reader was used.
+ */
+class GzipJsonStream {
+public:
+    GzipJsonStream(JsonStreamParser::Handler &handler);
+
+    virtual ~GzipJsonStream();
+
+    void write(const char *data, std::size_t size);
+
+    void write(const std::string &data) {
+        write(data.data(), data.size());
+    }
+
+    /**
+     * Flush everything through and check the document is complete
+     */
+    void close();
+
+    bool malformed() const;
+
+protected:
+    struct Priv;
+
+    std::unique_ptr<Priv> p;
+};
+
+}
+
+#endif // API_JSON_STREAM_H_
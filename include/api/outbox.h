@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_OUTBOX_H_
+#define API_OUTBOX_H_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace api {
+
+/**
+ * A persistent queue of the writes (likes, follows, comments) that still
+ * have to be sent to the server, oldest first.
+ *
+ * Each write lives in its own file, named after its sequence number. Files
+ * are written to a temporary name and renamed into place, and carry a
+ * checksum, so queued writes survive a restart and a crash can at worst
+ * lose the write that was being queued.
+ *
+ * All methods can be called from any thread.
+ */
+class Outbox {
+public:
+    typedef std::shared_ptr<Outbox> Ptr;
+
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Action {
+        like, unlike, follow, unfollow, comment
+    };
+
+    struct Entry {
+        std::uint64_t sequence = 0;
+
+        Action action = Action::like;
+
+        /// The track or user the write is about
+        std::string target;
+
+        /// The text of a comment
+        std::string body;
+
+        /// Digest of the credentials the write was made with
+        std::string owner;
+
+        /// Failed attempts to send it so far
+        unsigned int attempts = 0;
+
+        /// Not kept on disk: after a restart everything is due at once
+        Clock::time_point next_attempt;
+    };
+
+    /**
+     * Open (and create if needed) an outbox in @a directory, loading the
+     * writes queued there. With an empty @a directory nothing is kept on
+     * disk.
+     */
+    Outbox(const std::string &directory);
+
+    virtual ~Outbox() = default;
+
+    /**
+     * Queue @a entry at the end, giving it the next sequence number
+     */
+    Entry push(Entry entry);
+
+    /**
+     * The oldest entry, if it is due. Entries are sent strictly in order,
+     * so that e.g. a like and its undo never swap places.
+     *
+     * @param due set to when the oldest entry is due, or to
+     *        Clock::time_point::max() when the outbox is empty
+     */
+    bool next(Entry &entry, Clock::time_point &due) const;
+
+    /**
+     * The entry was sent, or given up on
+     */
+    void remove(std::uint64_t sequence);
+
+    /**
+     * Sending the entry failed, try again at @a next_attempt
+     */
+    void retry(std::uint64_t sequence, Clock::time_point next_attempt);
+
+    /**
+     * Whether a queued write of @a owner puts @a target in a set (with
+     * action @a add) or takes it out (with @a remove). The newest such
+     * write decides @a present.
+     */
+    bool state(const std::string &owner, const std::string &target,
+               Action add, Action remove, bool &present) const;
+
+    /**
+     * Whether a write of @a owner with @a action on @a target is queued
+     */
+    bool queued(const std::string &owner, const std::string &target,
+                Action action) const;
+
+    std::deque<Entry> entries() const;
+
+protected:
+    std::string path(std::uint64_t sequence) const;
+
+    void load();
+
+    bool write(const Entry &entry);
+
+    std::string directory_;
+
+    std::deque<Entry> entries_;
+
+    std::uint64_t next_sequence_ = 1;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // API_OUTBOX_H_
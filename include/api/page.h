@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_PAGE_H_
+#define API_PAGE_H_
+
+#include <deque>
+#include <string>
+
+namespace api {
+
+/**
+ * One page of a list the API hands out in parts, with the cursors to the
+ * pages around it (linked_partitioning).
+ */
+template<typename T>
+struct Page {
+    std::deque<T> items;
+
+    /// The following page, empty on the last one
+    std::string next_href;
+
+    /// Items added in front of the list since, for activity streams
+    std::string future_href;
+};
+
+}
+
+#endif // API_PAGE_H_
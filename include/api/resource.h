@@ -25,6 +25,9 @@
 
 namespace api {
 
+template<typename T>
+struct Schema;
+
 class Resource {
 public:
     enum class Kind {
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef API_RESULT_CACHE_H_
+#define API_RESULT_CACHE_H_
+
+#include <api/comment.h>
+#include <api/page.h>
+#include <api/track.h>
+#include <api/user.h>
+
+#include <chrono>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace api {
+
+/**
+ * Rough heap footprint of the parsed objects, used to bound the cache
+ */
+std::size_t approximate_size(const Track &track);
+
+std::size_t approximate_size(const User &user);
+
+std::size_t approximate_size(const Comment &comment);
+
+inline std::size_t approximate_size(bool) {
+    return sizeof(bool);
+}
+
+template<typename T>
+std::size_t approximate_size(const std::deque<T> &items) {
+    std::size_t size = sizeof(items);
+    for (const auto &item : items) {
+        size += approximate_size(item);
+    }
+    return size;
+}
+
+template<typename T>
+std::size_t approximate_size(const Page<T> &page) {
+    return approximate_size(page.items) + page.next_href.capacity()
+            + page.future_href.capacity();
+}
+
+/**
+ * A memory-bounded LRU of parsed API results, shared by all queries.
+ *
+ * Values of any type with an approximate_size() overload can be stored.
+ * A lookup with a different type than the one stored is a miss.
+ *
+ * All methods can be called from any thread.
+ */
+class ResultCache {
+public:
+    typedef std::shared_ptr<ResultCache> Ptr;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Statistics {
+        unsigned int hits = 0;
+
+        unsigned int misses = 0;
+
+        std::size_t bytes = 0;
+
+        std::size_t entries = 0;
+    };
+
+    ResultCache(std::size_t max_bytes);
+
+    virtual ~ResultCache() = default;
+
+    /**
+     * Look up a live entry of type T, or return nullptr.
+     *
+     * Expired entries stay around until they are evicted, and can still be
+     * fetched with @a include_stale, e.g. once the server confirmed they
+     * have not changed.
+     */
+    template<typename T>
+    std::shared_ptr<const T> get(const std::string &key,
+                                 bool include_stale = false) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end() || *it->second->type != typeid(T)
+                || (!include_stale && it->second->expiry < Clock::now())) {
+            ++statistics_.misses;
+            return std::shared_ptr<const T>();
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++statistics_.hits;
+        return std::static_pointer_cast<const T>(it->second->value);
+    }
+
+    template<typename T>
+    void put(const std::string &key, const T &value, Clock::duration ttl) {
+        Item item;
+        item.key = key;
+        item.value = std::make_shared<const T>(value);
+        item.type = &typeid(T);
+        item.bytes = key.size() + approximate_size(value);
+        item.expiry = Clock::now() + ttl;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert(std::move(item));
+    }
+
+    void remove(const std::string &key);
+
+    /**
+     * Remove every entry whose key starts with @a prefix
+     */
+    void remove_prefix(const std::string &prefix);
+
+    void clear();
+
+    Statistics statistics() const;
+
+protected:
+    struct Item {
+        std::string key;
+
+        std::shared_ptr<const void> value;
+
+        const std::type_info *type;
+
+        std::size_t bytes;
+
+        Clock::time_point expiry;
+    };
+
+    void insert(Item &&item);
+
+    void erase(std::list<Item>::iterator it);
+
+    std::size_t max_bytes_;
+
+    std::list<Item> lru_;
+
+    std::unordered_map<std::string, std::list<Item>::iterator> index_;
+
+    Statistics statistics_;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // API_RESULT_CACHE_H_
@@ -94,6 +94,13 @@ public:
     std::string kind_str() const override;
 
 protected:
+    template<typename> friend struct Schema;
+
+    /**
+     * Tidy up the raw values returned by the server
+     */
+    void normalize();
+
     unsigned int id_;
 
     std::string title_;
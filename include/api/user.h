@@ -59,6 +59,8 @@ public:
     std::string kind_str() const override;
 
 protected:
+    template<typename> friend struct Schema;
+
     std::string title_;
 
     unsigned int id_;
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef API_WAKER_H_
+#define API_WAKER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace api {
+
+/**
+ * Wakes up a thread that waits for the first of several results, e.g.
+ * the futures of a session and the channels their tracks come through.
+ *
+ * Whatever settles or offers something calls notify(). The waiting
+ * thread reads count() before it looks at its results, so that nothing
+ * that comes in while it looks is missed.
+ */
+class Waker {
+public:
+    typedef std::shared_ptr<Waker> Ptr;
+
+    void notify() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++count_;
+        cond_.notify_all();
+    }
+
+    /**
+     * Number of notifications so far
+     */
+    std::uint64_t count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    /**
+     * Wait until there were notifications since count() returned @a seen,
+     * or until @a deadline.
+     *
+     * @return false if the deadline passed first
+     */
+    template<typename Clock, typename Duration>
+    bool wait_until(std::uint64_t seen,
+                    const std::chrono::time_point<Clock, Duration> &deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_until(lock, deadline, [this, seen]() {
+            return count_ != seen;
+        });
+    }
+
+protected:
+    std::uint64_t count_ = 0;
+
+    mutable std::mutex mutex_;
+
+    std::condition_variable cond_;
+};
+
+}
+
+#endif // API_WAKER_H_
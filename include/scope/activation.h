@@ -21,6 +21,9 @@
 #define SCOPE_ACTIVATIOIN_H_
 
 #include <api/client.h>
+#include <scope/preview_cache.h>
+
+#include <chrono>
 
 #include <unity/scopes/ActivationQueryBase.h>
 
@@ -41,13 +44,23 @@ namespace scope {
 class Activation : public unity::scopes::ActivationQueryBase
 {
 public:
+    /**
+     * @param budget time allowed for the action's requests, from now
+     * @param busy kept until the action is destroyed
+     * @param cache preview data the action's writes are applied to
+     */
     Activation(const unity::scopes::Result &result,
            const unity::scopes::ActionMetadata & metadata,
            std::string const& action_id,
-           std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client);
+           const api::Client &client,
+           const std::chrono::milliseconds &budget,
+           const std::shared_ptr<void> &busy = std::shared_ptr<void>(),
+           const PreviewCache::Ptr &cache = PreviewCache::Ptr());
 
     ~Activation() = default;
 
+    void cancelled() override;
+
      /**
      * Trigger the action object with action id.
      */
@@ -57,6 +70,13 @@ private:
     std::string const action_id_;
     
     api::Client client_;
+
+    /**
+     * Holds off background cache warming for as long as this lives
+     */
+    std::shared_ptr<void> busy_;
+
+    PreviewCache::Ptr cache_;
 };
 
 }
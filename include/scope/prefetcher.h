@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SCOPE_PREFETCHER_H_
+#define SCOPE_PREFETCHER_H_
+
+#include <api/client.h>
+#include <scope/preview_cache.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace scope {
+
+/**
+ * Fetches what the previews of the top search results need (comments, and
+ * whether the user likes the track and follows its author) into a
+ * PreviewCache, so that opening one of them needs no network.
+ *
+ * Tracks are fetched one at a time on a single thread, so that the
+ * prefetch never competes much with the queries themselves. A new
+ * prefetch replaces the one running.
+ *
+ * All methods can be called from any thread.
+ */
+class Prefetcher {
+public:
+    typedef std::shared_ptr<Prefetcher> Ptr;
+
+    struct Target {
+        std::string trackid;
+
+        /// The author of the track
+        std::string userid;
+    };
+
+    /**
+     * @param budget time allowed for each prefetch
+     */
+    Prefetcher(const PreviewCache::Ptr &cache,
+               const std::chrono::milliseconds &budget);
+
+    ~Prefetcher();
+
+    /**
+     * Fetch the preview data of @a targets, in order, through @a session.
+     * Cancelling @a session stops the prefetch.
+     */
+    void prefetch(const api::Client &session,
+                  const std::vector<Target> &targets);
+
+    /**
+     * Cancel the prefetch running and wait for the thread to finish
+     */
+    void stop();
+
+protected:
+    struct Job {
+        std::shared_ptr<api::Client> session;
+
+        std::vector<Target> targets;
+    };
+
+    void run();
+
+    /**
+     * Fetch the preview data of one track. Throws if any of it failed, in
+     * which case nothing is stored.
+     */
+    void fetch(api::Client &session, const Target &target);
+
+    PreviewCache::Ptr cache_;
+
+    std::chrono::milliseconds budget_;
+
+    /// The prefetch waiting to start
+    std::shared_ptr<Job> next_;
+
+    /// The session of the prefetch running
+    std::shared_ptr<api::Client> running_;
+
+    bool stopping_ = false;
+
+    std::mutex mutex_;
+
+    std::condition_variable wake_;
+
+    std::thread thread_;
+};
+
+}
+
+#endif // SCOPE_PREFETCHER_H_
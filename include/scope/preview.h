@@ -21,8 +21,12 @@
 #define SCOPE_PREVIEW_H_
 
 #include <api/client.h>
+#include <scope/preview_cache.h>
+
+#include <chrono>
 
 #include <unity/scopes/PreviewQueryBase.h>
+#include <unity/scopes/PreviewWidget.h>
 #include <unity/scopes/OnlineAccountClient.h>
 
 namespace unity {
@@ -41,9 +45,17 @@ namespace scope {
  */
 class Preview: public unity::scopes::PreviewQueryBase {
 public:
+    /**
+     * @param budget time allowed for all of the preview's requests, from now
+     * @param busy kept until the preview is destroyed
+     * @param cache preview data of the tracks seen lately, read and filled
+     */
     Preview(const unity::scopes::Result &result,
             const unity::scopes::ActionMetadata &metadata,
-            std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client);
+            const api::Client &client,
+            const std::chrono::milliseconds &budget,
+            const std::shared_ptr<void> &busy = std::shared_ptr<void>(),
+            const PreviewCache::Ptr &cache = PreviewCache::Ptr());
 
     ~Preview() = default;
 
@@ -55,7 +67,25 @@ public:
     void run(unity::scopes::PreviewReplyProxy const& reply) override;
     
 private:
+    /**
+     * The actions of a track preview, with the like and follow buttons
+     * matching the user's relationship to the track
+     */
+    unity::scopes::PreviewWidget track_actions(bool liked, bool following);
+
+    unity::scopes::PreviewWidgetList track_comments(const std::deque<api::Comment> &comments);
+
     api::Client client_;
+
+    /// Notified by the requests of client_
+    api::Waker::Ptr waker_;
+
+    /**
+     * Holds off background cache warming for as long as this lives
+     */
+    std::shared_ptr<void> busy_;
+
+    PreviewCache::Ptr cache_;
 };
 
 }
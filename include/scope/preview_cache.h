@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SCOPE_PREVIEW_CACHE_H_
+#define SCOPE_PREVIEW_CACHE_H_
+
+#include <api/comment.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace scope {
+
+/**
+ * What a track preview fetches, for the tracks most recently fetched for,
+ * so that opening them again needs no network.
+ *
+ * Entries expire after a while, as others comment on the tracks. The
+ * user's own writes are applied to them as they are made.
+ *
+ * All methods can be called from any thread.
+ */
+class PreviewCache {
+public:
+    typedef std::shared_ptr<PreviewCache> Ptr;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        /// Whose like and follow state this is; empty if no one is logged in
+        std::string owner;
+
+        /// The author of the track
+        std::string userid;
+
+        std::deque<api::Comment> comments;
+
+        bool liked = false;
+
+        bool following = false;
+    };
+
+    /**
+     * Keep the entries of at most @a capacity tracks, dropping the least
+     * recently used first, each for @a max_age
+     */
+    PreviewCache(std::size_t capacity, Clock::duration max_age);
+
+    virtual ~PreviewCache() = default;
+
+    /**
+     * The entry of @a trackid, if there is one for @a owner
+     */
+    bool get(const std::string &trackid, const std::string &owner,
+             Entry &entry);
+
+    /**
+     * Store what was fetched for @a trackid. If any of the user's writes
+     * was applied since #writes() returned @a writes, the entry may have
+     * been fetched before it, and is dropped.
+     */
+    void put(const std::string &trackid, const Entry &entry,
+             std::uint64_t writes = UINT64_MAX);
+
+    /**
+     * How many writes have been applied so far; read it before fetching
+     */
+    std::uint64_t writes() const;
+
+    /**
+     * @a owner liked or unliked @a trackid
+     */
+    void set_liked(const std::string &owner, const std::string &trackid,
+                   bool liked);
+
+    /**
+     * @a owner followed or unfollowed @a userid, the author of any number
+     * of tracks
+     */
+    void set_following(const std::string &owner, const std::string &userid,
+                       bool following);
+
+    /**
+     * Forget @a trackid, e.g. because its comments changed
+     */
+    void erase(const std::string &trackid);
+
+    std::size_t size() const;
+
+protected:
+    struct Slot {
+        std::string trackid;
+
+        Entry entry;
+
+        Clock::time_point expiry;
+    };
+
+    typedef std::list<Slot> Entries;
+
+    void erase(Entries::iterator it);
+
+    std::size_t capacity_;
+
+    Clock::duration max_age_;
+
+    /// Most recently used first
+    Entries entries_;
+
+    std::map<std::string, Entries::iterator> index_;
+
+    std::uint64_t writes_ = 0;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // SCOPE_PREVIEW_CACHE_H_
@@ -20,6 +20,12 @@
 #define SCOPE_QUERY_H_
 
 #include <api/client.h>
+#include <scope/prefetcher.h>
+#include <scope/snapshot.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
 
 #include <unity/scopes/SearchQueryBase.h>
 #include <unity/scopes/ReplyProxyFwd.h>
@@ -35,11 +41,33 @@ namespace scope {
  */
 class Query: public unity::scopes::SearchQueryBase {
 public:
+    /**
+     * @param budget time allowed for all of the query's requests, from now
+     * @param home_genres genres whose hottest tracks are merged into the
+     *        home page's Explore category; the first music department if
+     *        there are none
+     * @param busy kept until the query is destroyed
+     * @param snapshot where the surfacing page is shown from, and kept
+     * @param prefetcher given the top search results once they are pushed
+     */
     Query(const unity::scopes::CannedQuery &query,
           const unity::scopes::SearchMetadata &metadata,
-          std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client);
+          const api::Client &client,
+          const std::chrono::milliseconds &budget,
+          const std::vector<std::string> &home_genres = std::vector<std::string>(),
+          const std::shared_ptr<void> &busy = std::shared_ptr<void>(),
+          const Snapshot::Ptr &snapshot = Snapshot::Ptr(),
+          const Prefetcher::Ptr &prefetcher = Prefetcher::Ptr());
+
+    ~Query();
 
-    ~Query() = default;
+    /**
+     * Make the requests a query of @a department_id with an empty search
+     * string makes, and wait for them, so that they are cached when that
+     * query comes. Throws the first of their failures.
+     */
+    static void warm(api::Client &client, const std::string &department_id,
+                     const std::vector<std::string> &home_genres);
 
     void cancelled() override;
 
@@ -47,10 +75,80 @@ public:
 
 private:
     void add_login_nag(const unity::scopes::SearchReplyProxy &reply);
+
+    /**
+     * Push @a result, unless the page is being refreshed behind its
+     * snapshot, and add it to the snapshot being taken
+     */
+    bool push(const unity::scopes::SearchReplyProxy &reply,
+              const unity::scopes::CategorisedResult &result);
+
+    /**
+     * Push the results of a snapshot to those of @a categories they were
+     * taken from
+     */
+    bool replay(const unity::scopes::SearchReplyProxy &reply,
+                const std::vector<Snapshot::Item> &items,
+                const std::vector<unity::scopes::Category::SCPtr> &categories);
+
     bool push_track(const unity::scopes::SearchReplyProxy &reply,
                     const unity::scopes::Category::SCPtr &category,
                     const api::Track &track);
 
+    /**
+     * A track list being pushed to its category as it arrives
+     */
+    struct TrackFeed {
+        unity::scopes::Category::SCPtr category;
+
+        std::future<std::deque<api::Track>> tracks;
+
+        api::Client::TrackChannel channel;
+
+        /// Where the pages after tracks come from, for lists read in full
+        api::Client::TrackPager::Ptr pager;
+
+        std::size_t pushed = 0;
+
+        /// Tracks pushed before the page in tracks
+        std::size_t page_start = 0;
+
+        bool done = false;
+    };
+
+    /**
+     * Push the tracks @a feed has ready, without blocking: those already
+     * out of its channel, then the rest of the list once it is complete.
+     * A paged feed then moves on to its next page, until the pager is
+     * exhausted. Sets @a progress if anything happened.
+     */
+    bool pump_tracks(const unity::scopes::SearchReplyProxy &reply,
+                     TrackFeed &feed, bool &progress);
+
+    /**
+     * The home page's Explore category, merged from several genres
+     */
+    struct HomeFeed {
+        unity::scopes::Category::SCPtr category;
+
+        /// The hottest tracks of each genre
+        std::vector<std::future<std::deque<api::Track>>> genres;
+
+        /// When each genre is given up on
+        std::vector<std::chrono::steady_clock::time_point> deadlines;
+
+        std::size_t pushed = 0;
+
+        bool done = true;
+    };
+
+    /**
+     * Once every genre of @a feed is in, or out of time, push the merge
+     * of those that made it. Sets @a progress if anything happened.
+     */
+    bool pump_home(const unity::scopes::SearchReplyProxy &reply,
+                   HomeFeed &feed, bool &progress);
+
     bool push_user_info(const unity::scopes::SearchReplyProxy &reply,
                            const unity::scopes::Category::SCPtr &category,
                            const api::User &user);
@@ -58,6 +156,36 @@ private:
     bool show_empty_tip(const unity::scopes::SearchReplyProxy &reply);
 
     api::Client client_;
+
+    /// Notified by the requests of client_ and the channels of their tracks
+    api::Waker::Ptr waker_;
+
+    std::vector<std::string> home_genres_;
+
+    /**
+     * Holds off background cache warming for as long as this lives
+     */
+    std::shared_ptr<void> busy_;
+
+    Snapshot::Ptr snapshot_;
+
+    /// The snapshot being taken of the surfacing page
+    std::vector<Snapshot::Item> recorded_;
+
+    bool recording_ = false;
+
+    /// The page was shown from the snapshot; results are only recorded
+    bool refreshing_ = false;
+
+    Prefetcher::Ptr prefetcher_;
+
+    /// Cancelled with the query, but not bound by its budget
+    api::Client prefetch_session_;
+
+    /// The first tracks pushed, if they are search results
+    std::vector<Prefetcher::Target> visible_;
+
+    bool prefetching_ = false;
 };
 
 }
@@ -19,6 +19,16 @@
 #ifndef SCOPE_SCOPE_H_
 #define SCOPE_SCOPE_H_
 
+#include <api/client.h>
+#include <scope/prefetcher.h>
+#include <scope/preview_cache.h>
+#include <scope/snapshot.h>
+#include <scope/warmer.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
 #include <unity/scopes/ScopeBase.h>
 #include <unity/scopes/OnlineAccountClient.h>
 #include <unity/scopes/QueryBase.h>
@@ -72,6 +82,52 @@ public:
 
 protected:
     std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client_;
+
+    /**
+     * Shared HTTP runtime; each query gets its own session of it
+     */
+    api::Client::Ptr client_;
+
+    /**
+     * Time allowed for all the requests of one search, preview and
+     * activation respectively
+     */
+    std::chrono::milliseconds search_budget_ { 10000 };
+
+    std::chrono::milliseconds preview_budget_ { 10000 };
+
+    std::chrono::milliseconds activation_budget_ { 10000 };
+
+    /**
+     * Genres merged into the home page's Explore category. Just the
+     * default one, unless more are configured.
+     */
+    std::vector<std::string> home_genres_;
+
+    /**
+     * Warms the caches while no query is running
+     */
+    Warmer::Ptr warmer_;
+
+    /**
+     * Wait before the first round of warming, and between rounds
+     */
+    std::chrono::milliseconds warm_delay_ { 2000 };
+
+    std::chrono::milliseconds warm_interval_ { 600000 };
+
+    /**
+     * The surfacing page as last shown
+     */
+    Snapshot::Ptr snapshot_;
+
+    /**
+     * Preview data per track: of the top search results, fetched ahead,
+     * and of the previews opened
+     */
+    PreviewCache::Ptr preview_cache_;
+
+    Prefetcher::Ptr prefetcher_;
 };
 
 }
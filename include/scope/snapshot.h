@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SCOPE_SNAPSHOT_H_
+#define SCOPE_SNAPSHOT_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace scope {
+
+/**
+ * The results last pushed to the surfacing page (user card, stream and
+ * Explore), kept on disk so that the page can be shown at once on the
+ * next visit, even after a restart, while it is refreshed behind it.
+ *
+ * Only the page of the most recent user is kept. All methods can be called
+ * from any thread.
+ */
+class Snapshot {
+public:
+    typedef std::shared_ptr<Snapshot> Ptr;
+
+    struct Item {
+        /// The id of the category the result was pushed to
+        std::string category;
+
+        /// What the card shows at a glance; the page changed if these did
+        std::string key;
+
+        /// The serialized result
+        std::string result;
+    };
+
+    /**
+     * Load the snapshot kept in @a file, if any. With an empty @a file
+     * nothing is kept on disk.
+     *
+     * @param changed called when a page that was shown from the snapshot
+     *        turns out to have changed
+     */
+    Snapshot(const std::string &file, const std::function<void()> &changed);
+
+    virtual ~Snapshot() = default;
+
+    /**
+     * The page last stored for @a owner
+     */
+    bool get(const std::string &owner, std::vector<Item> &items) const;
+
+    /**
+     * Store the page just fetched for @a owner. If the stored page was
+     * @a shown in its place and the keys of the two differ, #changed is
+     * called; returns whether it was.
+     */
+    bool put(const std::string &owner, const std::vector<Item> &items,
+             bool shown);
+
+protected:
+    void load();
+
+    void save() const;
+
+    std::string file_;
+
+    std::function<void()> changed_;
+
+    bool known_ = false;
+
+    std::string owner_;
+
+    std::vector<Item> items_;
+
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif // SCOPE_SNAPSHOT_H_
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SCOPE_WARMER_H_
+#define SCOPE_WARMER_H_
+
+#include <api/client.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace scope {
+
+/**
+ * Fills the caches in the background while the scope is idle, so that the
+ * home page (with the user card and the stream) and the departments used
+ * most are already there when the user turns to them.
+ *
+ * A round of warming starts shortly after start up and then again every
+ * interval. Only a few departments are warmed at once, with a random pause
+ * between them, and nothing new is started while an interactive query is
+ * running.
+ *
+ * All methods can be called from any thread.
+ */
+class Warmer: public std::enable_shared_from_this<Warmer> {
+public:
+    typedef std::shared_ptr<Warmer> Ptr;
+
+    /**
+     * Starts the first round after @a delay
+     *
+     * @param home_genres as given to each Query
+     * @param usage_file where the use of each department is counted
+     *        between runs; with an empty name it is forgotten
+     * @param concurrency departments warmed at once
+     * @param jitter upper bound of the random time added to each wait
+     * @param budget time allowed for the requests of one department
+     */
+    Warmer(const api::Client &client,
+           const std::vector<std::string> &home_genres,
+           const std::string &usage_file, unsigned int concurrency,
+           const std::chrono::milliseconds &delay,
+           const std::chrono::milliseconds &interval,
+           const std::chrono::milliseconds &jitter,
+           const std::chrono::milliseconds &budget);
+
+    ~Warmer();
+
+    /**
+     * Count a visit of @a department_id, which makes it more likely to be
+     * warmed
+     */
+    void used(const std::string &department_id);
+
+    /**
+     * No warming is started while the returned token is held, and for as
+     * long as any other is
+     */
+    std::shared_ptr<void> busy();
+
+    /**
+     * Cancel the warming in flight, wait for it to finish and store the
+     * use counts. Nothing is warmed afterwards.
+     */
+    void stop();
+
+protected:
+    void run();
+
+    /**
+     * The departments to warm this round, most used first
+     */
+    std::vector<std::string> plan() const;
+
+    void warm(const std::vector<std::string> &departments);
+
+    /**
+     * A random share of the jitter, called with #mutex_ held
+     */
+    std::chrono::milliseconds jitter();
+
+    void load();
+
+    void save() const;
+
+    api::Client client_;
+
+    std::vector<std::string> home_genres_;
+
+    std::string usage_file_;
+
+    unsigned int concurrency_;
+
+    std::chrono::milliseconds delay_;
+
+    std::chrono::milliseconds interval_;
+
+    std::chrono::milliseconds jitter_;
+
+    std::chrono::milliseconds budget_;
+
+    /// Visits of each department
+    std::map<std::string, unsigned int> uses_;
+
+    /// Interactive queries running
+    unsigned int busy_ = 0;
+
+    bool stopping_ = false;
+
+    /// The sessions warming departments right now
+    std::list<api::Client> sessions_;
+
+    std::mt19937 random_;
+
+    mutable std::mutex mutex_;
+
+    std::condition_variable idle_;
+
+    std::thread thread_;
+};
+
+}
+
+#endif // SCOPE_WARMER_H_
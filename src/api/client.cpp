@@ -20,17 +20,31 @@
 #include <api/client.h>
 #include <api/track.h>
 #include <api/comment.h>
+#include <api/decoder.h>
+#include <api/disk_cache.h>
+#include <api/hotness.h>
+#include <api/id_index.h>
+#include <api/json_stream.h>
+#include <api/outbox.h>
+#include <api/result_cache.h>
 
-#include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/algorithm/string.hpp>
 #include <core/net/error.h>
 #include <core/net/http/client.h>
 #include <core/net/http/content_type.h>
 #include <core/net/http/response.h>
+#include <core/net/http/streaming_client.h>
+#include <core/net/http/streaming_request.h>
 #include <json/json.h>
 
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <typeinfo>
 
 namespace http = core::net::http;
 namespace io = boost::iostreams;
@@ -43,333 +57,2099 @@ using namespace std;
 namespace {
 
 template<typename T>
-static deque<T> get_typed_list(const string &filter, const json::Value &root) {
-    deque<T> results;
-    for (json::ArrayIndex index = 0; index < root.size(); ++index) {
-        json::Value item = root[index];
+static T is_successful(const json::Value &root) {
+    T results = (boost::algorithm::contains(root["status"].asString(), "201")
+                  || boost::algorithm::contains(root["status"].asString(), "200")
+                  || root["id"].asUInt() > 0);
+    return results;
+}
+
+/**
+ * How long a credential snapshot is trusted before the online accounts
+ * service is asked again. Account changes signalled by the service
+ * invalidate it earlier.
+ */
+static const chrono::seconds CONFIG_TTL(120);
+
+/**
+ * Upper bound for the on-disk response cache
+ */
+static const size_t DISK_CACHE_SIZE = 20 * 1024 * 1024;
+
+/**
+ * Upper bound for the parsed results kept in memory
+ */
+static const size_t RESULT_CACHE_SIZE = 8 * 1024 * 1024;
+
+/**
+ * How long the local favorites and followings indexes are trusted before
+ * they are synced again, and how long to wait after a failed sync
+ */
+static const chrono::minutes RELATIONSHIPS_MAX_AGE(10);
+
+static const chrono::minutes RELATIONSHIPS_RETRY(1);
+
+/**
+ * IDs fetched per index sync (the most the API returns at once), and the
+ * time allowed for it
+ */
+static const size_t RELATIONSHIPS_SYNC_LIMIT = 200;
+
+static const chrono::seconds RELATIONSHIPS_SYNC_BUDGET(30);
+
+/**
+ * Time allowed to send one write from the outbox, and how often it is
+ * tried before it is dropped. Retries back off exponentially, from
+ * OUTBOX_RETRY up to OUTBOX_MAX_RETRY.
+ */
+static const chrono::seconds OUTBOX_SEND_BUDGET(30);
+
+static const unsigned int OUTBOX_MAX_ATTEMPTS = 8;
+
+static const chrono::seconds OUTBOX_RETRY(5);
+
+static const chrono::minutes OUTBOX_MAX_RETRY(10);
+
+/**
+ * Tracks per page when the caller does not say, and per chunk of the
+ * favorites
+ */
+static const unsigned int PAGE_LIMIT = 50;
+
+/**
+ * Pages of PAGE_LIMIT tracks in the candidate pool of a genre, which is
+ * ranked by hotness locally. Pools are fetched again in the background
+ * once they are HOT_POOL_MAX_AGE old, in the time HOT_POOL_BUDGET allows.
+ * Their pages are cached for no longer than that.
+ */
+static const unsigned int HOT_POOL_PAGES = 4;
+
+static const chrono::minutes HOT_POOL_MAX_AGE(30);
 
-        string kind = item["kind"].asString();
+static const chrono::seconds HOT_POOL_BUDGET(30);
+
+/**
+ * Most IDs the API takes in one tracks.json?ids= request
+ */
+static const size_t TRACK_IDS_LIMIT = 50;
+
+static bool parse_id(const string &text, unsigned int &id) {
+    try {
+        id = stoul(text);
+        return true;
+    } catch (logic_error &) {
+        return false;
+    }
+}
 
-        if (kind == filter) {
-            results.emplace_back(T(item));
+static string unescape(const string &text) {
+    string result;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size()
+                && isxdigit((unsigned char) text[i + 1])
+                && isxdigit((unsigned char) text[i + 2])) {
+            result += char(stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else if (text[i] == '+') {
+            result += ' ';
+        } else {
+            result += text[i];
         }
     }
-    return results;
+    return result;
 }
 
-template<typename T>
-static deque<T> get_typed_activity_list(const string &filter, const json::Value &root) {
-    deque<T> results;
-    json::Value collection = root["collection"];
-    for (json::ArrayIndex index = 0; index < collection.size(); ++index) {
-        json::Value item = collection[index];
+/**
+ * Split a cursor from the API (e.g. next_href) into the path and the
+ * parameters of a request to our own API root. The credentials in it are
+ * dropped, every request adds the current ones.
+ */
+static bool parse_href(const string &href, net::Uri::Path &path,
+                       net::Uri::QueryParameters &parameters) {
+    size_t scheme = href.find("://");
+    size_t start = href.find('/', scheme == string::npos ? 0 : scheme + 3);
+    if (scheme == string::npos || start == string::npos) {
+        return false;
+    }
+    size_t query = href.find('?', start);
+
+    vector<string> elements;
+    boost::algorithm::split(elements, href.substr(start, query - start),
+                            boost::algorithm::is_any_of("/"));
+    path.clear();
+    for (const auto &element : elements) {
+        if (!element.empty()) {
+            path.emplace_back(unescape(element));
+        }
+    }
 
-        string activity_type = item["type"].asString();
+    parameters.clear();
+    if (query != string::npos) {
+        vector<string> pairs;
+        boost::algorithm::split(pairs, href.substr(query + 1),
+                                boost::algorithm::is_any_of("&"));
+        for (const auto &pair : pairs) {
+            size_t equals = pair.find('=');
+            string name = unescape(pair.substr(0, equals));
+            if (name.empty() || name == "client_id" || name == "oauth_token") {
+                continue;
+            }
+            parameters.emplace_back(name, equals == string::npos ?
+                    string() : unescape(pair.substr(equals + 1)));
+        }
+    }
+    return !path.empty();
+}
 
-        if (activity_type == filter) {
-            results.emplace_back(T(item["origin"]));
+/**
+ * Request parameters for a track search, and whether the results have to
+ * be sorted locally
+ */
+static net::Uri::QueryParameters search_parameters(
+        const deque<pair<SP, string>> &parameters, bool &sort) {
+    sort = false;
+    net::Uri::QueryParameters params;
+    for(const auto &p: parameters) {
+        switch(p.first){
+        case SP::genre:
+            params.emplace_back(make_pair("genres", p.second));
+            break;
+        case SP::limit:
+            params.emplace_back(make_pair("limit", p.second));
+            break;
+        case SP::order:
+            sort = true;
+            break;
+        case SP::query:
+            params.emplace_back(make_pair("q", p.second));
+            break;
         }
     }
-    return results;
+    return params;
 }
 
-template<typename T>
-static T get_typed_authuser_info(const string &filter, const json::Value &root) {
-    T results((json::Value()));
+/**
+ * Unfortunately SoundCloud doesn't support ordering by hotness any more
+ * See excuse on developer blog: https://developers.soundcloud.com/blog/removing-hotness-param
+ */
+static ListDecoder<Track>::Order search_order(bool sort) {
+    ListDecoder<Track>::Order order;
+    if (sort) {
+        auto now = chrono::system_clock::now();
+        order = [now](const Track &i, const Track &j) {
+            return hotness(i, now) > hotness(j, now);
+        };
+    }
+    return order;
+}
 
-    string kind = root["kind"].asString();
+/**
+ * How long GET responses from each endpoint may be served from the disk
+ * cache. Zero means the endpoint is never cached, e.g. the relationship
+ * checks which our own writes change.
+ */
+static chrono::seconds cache_ttl(const net::Uri::Path &path,
+                                 const net::Uri::QueryParameters &parameters) {
+    if (path.empty()) {
+        return chrono::seconds(0);
+    }
+    const string &resource = path.front();
+    if (resource == "tracks.json") {
+        bool offset = false, cursor = false;
+        for (const auto &parameter : parameters) {
+            if (parameter.first == "q") {
+                return chrono::minutes(15);
+            } else if (parameter.first == "ids") {
+                return chrono::minutes(10);
+            }
+            offset |= parameter.first == "offset";
+            cursor |= parameter.first == "linked_partitioning";
+        }
+        // The pages of a hot pool, which must not outlive the pool: its
+        // refresh would get the same tracks back from the cache
+        if (offset && !cursor) {
+            return HOT_POOL_MAX_AGE;
+        }
+        // Genre pages change slowly
+        return chrono::hours(1);
+    } else if (resource == "tracks") {
+        return chrono::minutes(10);
+    } else if (resource == "users") {
+        return path.size() > 2 ? chrono::minutes(30) : chrono::hours(1);
+    } else if (resource == "me") {
+        if (path.size() == 1) {
+            return chrono::minutes(10);
+        } else if (path[1] == "activities") {
+            return chrono::minutes(2);
+        } else if (path[1] == "favorites.json") {
+            return chrono::minutes(5);
+        }
+    }
+    return chrono::seconds(0);
+}
 
-    if (kind == filter) {
-        return T(root);
+/**
+ * The start of the cache keys of every request for @a path, whatever its
+ * parameters
+ */
+static string cache_prefix(const Config &config, const net::Uri::Path &path) {
+    string prefix = config.apiroot;
+    for (const auto &element : path) {
+        prefix += "/" + element;
     }
-    return results;
+    return prefix;
 }
 
-template<typename T>
-static T is_successful(const json::Value &root) {
-    T results = (boost::algorithm::contains(root["status"].asString(), "201")
-                  || boost::algorithm::contains(root["status"].asString(), "200")
-                  || root["id"].asUInt() > 0);
-    return results;
+/**
+ * Normalized cache key for a request: parameters are sorted, and the
+ * credentials are replaced by a digest so that no token ends up on disk,
+ * but different users never share entries.
+ */
+static string cache_key(const Config &config, const net::Uri::Path &path,
+                        const net::Uri::QueryParameters &parameters) {
+    net::Uri::QueryParameters sorted(parameters);
+    sort(sorted.begin(), sorted.end());
+
+    string key = cache_prefix(config, path);
+    char separator = '?';
+    for (const auto &parameter : sorted) {
+        key += separator + parameter.first + "=" + parameter.second;
+        separator = '&';
+    }
+    if (config.authenticated) {
+        key += "#user-" + DiskCache::digest(config.access_token);
+    } else {
+        key += "#anonymous";
+    }
+    return key;
+}
+
+/**
+ * First value of a (case-insensitively matched) response header
+ */
+static string header_value(const http::Header &header, const string &name) {
+    string result;
+    header.enumerate([&result, &name](const string &key, const set<string> &values) {
+        if (result.empty() && !values.empty()
+                && boost::algorithm::iequals(key, name)) {
+            result = *values.begin();
+        }
+    });
+    return result;
 }
 
+/**
+ * How long a response may be reused: our own per-endpoint TTL. A server
+ * max-age does not shorten it, or every response sent with max-age=0
+ * would be stale at once; no-cache has the response revalidated on every
+ * use.
+ */
+static chrono::seconds response_ttl(const http::Response &response,
+                                    chrono::seconds ttl) {
+    string cache_control = header_value(response.header, "Cache-Control");
+    if (boost::algorithm::icontains(cache_control, "no-cache")) {
+        return chrono::seconds(0);
+    }
+    return ttl;
+}
+
+/**
+ * Whether the server lets us keep a response at all
+ */
+static bool storable(const http::Response &response) {
+    return !boost::algorithm::icontains(
+            header_value(response.header, "Cache-Control"), "no-store");
 }
 
+/**
+ * A GET response with an error status and a body that did not decode
+ */
+struct StatusError: public runtime_error {
+    StatusError(http::Status status) :
+            runtime_error("HTTP status " + to_string(static_cast<int>(status))),
+            status(status) {
+    }
+
+    http::Status status;
+};
+
+/**
+ * Whether @a error is the server refusing the request itself, with a 4xx
+ * status, rather than the network or the server failing
+ */
+static bool refused(const exception_ptr &error) {
+    try {
+        rethrow_exception(error);
+    } catch (StatusError &e) {
+        int status = static_cast<int>(e.status);
+        return status >= 400 && status < 500;
+    } catch (...) {
+    }
+    return false;
+}
+
+/**
+ * An immutable, published copy of the client configuration.
+ */
+struct ConfigSnapshot {
+    typedef std::shared_ptr<const ConfigSnapshot> Ptr;
+
+    Config config;
+
+    chrono::steady_clock::time_point expiry;
+};
+
+/**
+ * A request that its session can break off when it is cancelled
+ */
+class Abortable {
+public:
+    virtual ~Abortable() = default;
+
+    virtual void abort(exception_ptr reason) = 0;
+
+    /**
+     * Have @a waker notified once the request is settled. Set before the
+     * request goes out.
+     */
+    void wake(const Waker::Ptr &waker) {
+        waker_ = waker;
+    }
+
+protected:
+    Waker::Ptr waker_;
+};
+
+/**
+ * The promise of one request's result. Whichever of the response and a
+ * cancellation comes first settles it, and the other is ignored.
+ */
+template<typename T>
+class Pending: public Abortable {
+public:
+    typedef shared_ptr<Pending<T>> Ptr;
+
+    /**
+     * Told the outcome on the thread that settles the promise, with
+     * either the value or the error
+     */
+    typedef function<void(const T *value, exception_ptr error)> Callback;
+
+    Pending(const Callback &callback = Callback()) :
+            callback_(callback) {
+    }
+
+    future<T> get_future() {
+        return promise_.get_future();
+    }
+
+    void set_value(const T &value) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (settled_) {
+                return;
+            }
+            settled_ = true;
+            promise_.set_value(value);
+        }
+        if (callback_) {
+            callback_(&value, exception_ptr());
+        }
+        // After the callback, which may settle what the waiter looks at
+        if (waker_) {
+            waker_->notify();
+        }
+    }
+
+    void set_exception(exception_ptr e) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (settled_) {
+                return;
+            }
+            settled_ = true;
+            promise_.set_exception(e);
+        }
+        if (callback_) {
+            callback_(nullptr, e);
+        }
+        // After the callback, which may settle what the waiter looks at
+        if (waker_) {
+            waker_->notify();
+        }
+    }
+
+    void abort(exception_ptr reason) override {
+        set_exception(reason);
+    }
+
+    bool settled() const {
+        lock_guard<mutex> lock(mutex_);
+        return settled_;
+    }
+
+protected:
+    promise<T> promise_;
+
+    Callback callback_;
+
+    bool settled_ = false;
+
+    mutable mutex mutex_;
+};
+
+}
+
+struct Client::Session {
+    std::atomic<bool> cancelled { false };
+
+    /// steady_clock ticks after which requests are aborted
+    std::atomic<chrono::steady_clock::rep> deadline {
+        chrono::steady_clock::time_point::max().time_since_epoch().count() };
+
+    std::atomic<unsigned int> credential_lookups { 0 };
+
+    std::atomic<unsigned int> credential_lookups_saved { 0 };
+
+    std::atomic<unsigned int> result_cache_hits { 0 };
+
+    std::atomic<unsigned int> result_cache_misses { 0 };
+
+    std::atomic<unsigned int> revalidated { 0 };
+
+    std::atomic<unsigned int> coalesced { 0 };
+
+    /**
+     * Requests of this session should stop: it was cancelled, or it ran
+     * out of time
+     */
+    bool aborted() const {
+        return cancelled
+                || chrono::steady_clock::now().time_since_epoch().count() >= deadline;
+    }
+
+    /**
+     * Why aborted() is true, for the requests that fail because of it
+     */
+    exception_ptr abort_reason() const {
+        return make_exception_ptr(domain_error(cancelled ?
+                "Request cancelled" : "Request deadline exceeded"));
+    }
+
+    /**
+     * Remember @a request so that cancel() can break it off.
+     *
+     * @return false if the session is aborted already
+     */
+    bool track(const shared_ptr<Abortable> &request) {
+        lock_guard<mutex> lock(requests_mutex);
+        if (aborted()) {
+            return false;
+        }
+        requests.erase(remove_if(requests.begin(), requests.end(),
+                                 [](const weak_ptr<Abortable> &r) {
+                                     return r.expired();
+                                 }), requests.end());
+        requests.emplace_back(request);
+        request->wake(waker);
+        return true;
+    }
+
+    /**
+     * Fail everything the session is waiting for straight away. The
+     * transfers themselves stop at their next progress report.
+     */
+    void cancel() {
+        vector<weak_ptr<Abortable>> pending;
+        {
+            lock_guard<mutex> lock(requests_mutex);
+            cancelled = true;
+            pending.swap(requests);
+        }
+        for (const auto &request : pending) {
+            if (auto r = request.lock()) {
+                r->abort(abort_reason());
+            }
+        }
+    }
+
+    /// Requests not yet finished, or finished but not yet pruned
+    vector<weak_ptr<Abortable>> requests;
+
+    /// Notified whenever one of the requests is settled
+    Waker::Ptr waker;
+
+    mutex requests_mutex;
+};
+
 class Client::Priv {
 public:
-    Priv(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client) :
-            client_(http::make_client()), worker_ { [this]() {client_->run();} },
-            oa_client_(oa_client), cancelled_(false) {
+    Priv(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client,
+         const std::string &cache_directory) :
+            client_(http::make_streaming_client()), worker_ { [this]() {client_->run();} },
+            oa_client_(oa_client), config_stale_(false),
+            result_cache_(make_shared<ResultCache>(RESULT_CACHE_SIZE)),
+            favorites_(make_shared<IdIndex>(RELATIONSHIPS_MAX_AGE, RELATIONSHIPS_RETRY)),
+            followings_(make_shared<IdIndex>(RELATIONSHIPS_MAX_AGE, RELATIONSHIPS_RETRY)) {
+        if (!cache_directory.empty()) {
+            disk_cache_ = make_shared<DiskCache>(cache_directory + "/http",
+                                                 DISK_CACHE_SIZE);
+        }
+        outbox_ = make_shared<Outbox>(cache_directory.empty() ?
+                string() : cache_directory + "/outbox");
+        sender_ = thread([this]() {send_outbox();});
     }
 
     ~Priv() {
+        {
+            lock_guard<mutex> lock(sender_mutex_);
+            stopping_ = true;
+            if (sending_) {
+                sending_->cancel();
+            }
+        }
+        sender_cond_.notify_all();
+        if (sender_.joinable()) {
+            sender_.join();
+        }
+
+        {
+            lock_guard<mutex> lock(syncs_mutex_);
+            for (const auto &sync : syncs_) {
+                sync.first->cancel();
+            }
+        }
+        for (const auto &sync : syncs_) {
+            sync.second.wait();
+        }
+
         client_->stop();
         if (worker_.joinable()) {
             worker_.join();
         }
     }
 
-    std::shared_ptr<core::net::http::Client> client_;
+    std::shared_ptr<core::net::http::StreamingClient> client_;
 
     std::thread worker_;
 
-    Config config_;
-    std::mutex config_mutex_;
+    /**
+     * Only ever accessed with atomic_load / atomic_store, so that readers
+     * never wait behind a credential lookup.
+     */
+    ConfigSnapshot::Ptr config_;
+
+    /**
+     * Serializes writers (and the online accounts client they use)
+     */
+    std::mutex refresh_mutex_;
 
     std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client_;
 
-    std::atomic<bool> cancelled_;
+    std::atomic<bool> config_stale_;
+
+    DiskCache::Ptr disk_cache_;
+
+    ResultCache::Ptr result_cache_;
+
+    /**
+     * GET requests currently on the network, by key. The values are
+     * InFlight<T> for the requested result type.
+     */
+    std::map<string, shared_ptr<void>> inflight_;
+
+    std::mutex inflight_mutex_;
 
-    void get(const net::Uri::Path &path,
+    /// Tracks the authenticated user likes
+    IdIndex::Ptr favorites_;
+
+    /// Users the authenticated user follows
+    IdIndex::Ptr followings_;
+
+    /**
+     * Index syncs running in the background, with their sessions
+     */
+    vector<pair<shared_ptr<Session>, future<void>>> syncs_;
+
+    std::mutex syncs_mutex_;
+
+    /// Writes waiting to be sent
+    Outbox::Ptr outbox_;
+
+    /**
+     * Sends the outbox in the background. The rest guards its state.
+     */
+    std::thread sender_;
+
+    std::mutex sender_mutex_;
+
+    std::condition_variable sender_cond_;
+
+    bool stopping_ = false;
+
+    /// Session of the write being sent
+    shared_ptr<Session> sending_;
+
+    /// The oldest write waits for a user to log in
+    bool parked_ = false;
+
+    /// Times the accounts may have changed, to catch a login while the
+    /// sender looks at the credentials
+    unsigned int account_changes_ = 0;
+
+    /**
+     * The activity stream as last fetched, so that later visits only
+     * fetch what is newer
+     */
+    struct Stream {
+        /// Whose stream it is
+        string owner;
+
+        deque<Track> tracks;
+
+        /// Cursor to the activities newer than tracks
+        string future_href;
+
+        /// How many tracks are kept
+        unsigned int limit = 0;
+    };
+
+    Stream stream_;
+
+    std::mutex stream_mutex_;
+
+    /**
+     * The tracks of a genre that are ranked by hotness
+     */
+    struct Pool {
+        deque<Track> tracks;
+
+        /// When tracks were fetched, if ever
+        chrono::steady_clock::time_point fetched;
+
+        bool refreshing = false;
+
+        /// Callers waiting for the first fetch, and how many tracks each
+        /// wants. Their sessions can break the wait off.
+        vector<pair<Pending<deque<Track>>::Ptr, size_t>> waiting;
+    };
+
+    /// Candidate pools, by genre
+    map<string, Pool> pools_;
+
+    std::mutex pools_mutex_;
+
+    void get(const Config &config,
+            const net::Uri::Path &path,
             const net::Uri::QueryParameters &parameters,
-            http::Request::Handler &handler) {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        http::Request::Configuration configuration = net_config(path, parameters);
-        configuration.header.add("User-Agent", config_.user_agent + " (gzip)");
+            const DiskCache::Entry *revalidate,
+            http::Request::Handler &handler,
+            const http::StreamingRequest::DataHandler &data_handler) {
+        http::Request::Configuration configuration = net_config(config, path, parameters);
+        configuration.header.add("User-Agent", config.user_agent + " (gzip)");
         configuration.header.add("Accept-Encoding", "gzip");
+        if (revalidate && !revalidate->etag.empty()) {
+            configuration.header.add("If-None-Match", revalidate->etag);
+        }
+        if (revalidate && !revalidate->last_modified.empty()) {
+            configuration.header.add("If-Modified-Since", revalidate->last_modified);
+        }
 
-        auto request = client_->head(configuration);
-        request->async_execute(handler);
+        auto request = client_->streaming_get(configuration);
+        request->async_execute(handler, data_handler);
     }
 
-    void post(const net::Uri::Path &path,
+    void post(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
             const net::Uri::QueryParameters &parameters,
             const std::string &postmsg,
             const std::string &content_type,
             http::Request::Handler &handler) {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        http::Request::Configuration configuration = net_config(path, parameters);
-        configuration.header.add("User-Agent", config_.user_agent);
+        ConfigSnapshot::Ptr snapshot = config(session);
+        http::Request::Configuration configuration = net_config(snapshot->config, path, parameters);
+        configuration.header.add("User-Agent", snapshot->config.user_agent);
         configuration.header.add("Content-Type", content_type);
       
         auto request = client_->post(configuration, postmsg, content_type);
         request->async_execute(handler);
     }
     
-    void put(const net::Uri::Path &path,
+    void put(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
             const net::Uri::QueryParameters &parameters,
             const std::string &postmsg,
             http::Request::Handler &handler) {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        http::Request::Configuration configuration = net_config(path, parameters);
-        configuration.header.add("User-Agent", config_.user_agent);
+        ConfigSnapshot::Ptr snapshot = config(session);
+        http::Request::Configuration configuration = net_config(snapshot->config, path, parameters);
+        configuration.header.add("User-Agent", snapshot->config.user_agent);
         std::istringstream is(postmsg);
 
         auto request = client_->put(configuration, is, postmsg.length());
         request->async_execute(handler);
     }
 
-    void del(const net::Uri::Path &path,
+    void del(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
             const net::Uri::QueryParameters &parameters,
             http::Request::Handler &handler) {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        http::Request::Configuration configuration = net_config(path, parameters);
-        configuration.header.add("User-Agent", config_.user_agent);
+        ConfigSnapshot::Ptr snapshot = config(session);
+        http::Request::Configuration configuration = net_config(snapshot->config, path, parameters);
+        configuration.header.add("User-Agent", snapshot->config.user_agent);
         configuration.header.add("X-HTTP-Method-Override", "DELETE");
 
         auto request = client_->post(configuration, "", "");
         request->async_execute(handler);
     }
 
-    http::Request::Configuration net_config(const net::Uri::Path &path,
+    http::Request::Configuration net_config(const Config &config,
+                                            const net::Uri::Path &path,
                                             const net::Uri::QueryParameters &parameters) {
-        update_config();
-
         http::Request::Configuration configuration;
         net::Uri::QueryParameters complete_parameters(parameters);
-        if (config_.authenticated) {
+        if (config.authenticated) {
             complete_parameters.emplace_back(
-                "oauth_token", config_.access_token);
+                "oauth_token", config.access_token);
         } else {
-            complete_parameters.emplace_back("client_id", config_.client_id);
+            complete_parameters.emplace_back("client_id", config.client_id);
         }
 
-        net::Uri uri = net::make_uri(config_.apiroot, path,
+        net::Uri uri = net::make_uri(config.apiroot, path,
                 complete_parameters);
         configuration.uri = client_->uri_to_string(uri);
 
 		return configuration;
 	}
 
-    http::Request::Progress::Next progress_report(
-            const http::Request::Progress&) {
-        return cancelled_ ?
-                http::Request::Progress::Next::abort_operation :
-                http::Request::Progress::Next::continue_operation;
+    static http::Request::Progress::Next progress_report(
+            const shared_ptr<Session> &session,
+            const http::Request::Progress&) {
+        return session->aborted() ?
+                http::Request::Progress::Next::abort_operation :
+                http::Request::Progress::Next::continue_operation;
+    }
+
+    /**
+     * A GET response being inflated and decoded as it arrives
+     */
+    template<typename T>
+    struct Download {
+        Download(const typename Decoder<T>::Factory &make_decoder) :
+                make_decoder(make_decoder), decoder(make_decoder()),
+                stream(*decoder) {
+        }
+
+        typename Decoder<T>::Factory make_decoder;
+
+        typename Decoder<T>::Ptr decoder;
+
+        GzipJsonStream stream;
+
+        /// The compressed body, only kept if it is going to be cached
+        string body;
+
+        bool keep_body = false;
+
+        bool received = false;
+
+        exception_ptr error;
+
+        void write(const string &data) {
+            received = true;
+            if (keep_body) {
+                body += data;
+            }
+            if (error) {
+                return;
+            }
+            try {
+                stream.write(data);
+            } catch(io::gzip_error &) {
+                error = current_exception();
+            }
+        }
+
+        T finish() {
+            if (error) {
+                rethrow_exception(error);
+            }
+            stream.close();
+            // Malformed documents decode like empty ones
+            return stream.malformed() ?
+                    make_decoder()->result() : decoder->result();
+        }
+    };
+
+    /**
+     * Inflate and decode a complete GET response body
+     */
+    template<typename T>
+    static T decode(const string &body,
+                    const typename Decoder<T>::Factory &make_decoder) {
+        Download<T> download(make_decoder);
+        download.write(body);
+        return download.finish();
+    }
+
+    /**
+     * A GET request on the network, and everyone waiting for its result
+     */
+    template<typename T>
+    struct InFlight {
+        vector<typename Pending<T>::Ptr> waiters;
+
+        /// The session of each waiter
+        vector<shared_ptr<Session>> sessions;
+    };
+
+    /**
+     * Take a finished request out of the in-flight table
+     */
+    template<typename T>
+    shared_ptr<InFlight<T>> finish(const string &flight_key) {
+        lock_guard<mutex> lock(inflight_mutex_);
+        auto it = inflight_.find(flight_key);
+        if (it == inflight_.end()) {
+            return make_shared<InFlight<T>>();
+        }
+        auto flight = static_pointer_cast<InFlight<T>>(it->second);
+        inflight_.erase(it);
+        return flight;
+    }
+
+    /**
+     * Issue a GET request and turn the response into a T with @a func,
+     * going through the whole Json::Value.
+     */
+    template<typename T>
+    future<T> async_get(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
+            const net::Uri::QueryParameters &parameters,
+            const function<T(const json::Value &root)> &func,
+            const string &variant = string()) {
+        return async_decode<T>(session, path, parameters,
+                [func]() {
+                    return make_shared<ValueDecoder<T>>(func);
+                }, variant);
+    }
+
+    /**
+     * Issue a GET request and decode the response straight into a T with
+     * the decoders from @a make_decoder.
+     *
+     * Cacheable results are looked up, in order, in the parsed result cache,
+     * the disk cache and finally on the network. An identical request that
+     * is already on the network is joined instead of issuing a new one.
+     * Use a distinct @a variant for each different decoder applied to the
+     * same endpoint. @a callback, if set, is told the outcome as soon as it
+     * is known, for work that has to follow without a thread waiting.
+     */
+    template<typename T>
+    future<T> async_decode(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
+            const net::Uri::QueryParameters &parameters,
+            const typename Decoder<T>::Factory &make_decoder,
+            const string &variant = string(),
+            const typename Pending<T>::Callback &callback = typename Pending<T>::Callback()) {
+        auto prom = make_shared<Pending<T>>(callback);
+
+        ConfigSnapshot::Ptr snapshot = config(session);
+
+        chrono::seconds ttl = cache_ttl(path, parameters);
+        string key = cache_key(snapshot->config, path, parameters);
+        string result_key = key + "|" + variant;
+        ResultCache::Ptr results;
+        if (ttl.count() > 0) {
+            results = result_cache_;
+
+            // Already parsed by an earlier query
+            if (auto value = results->template get<T>(result_key)) {
+                ++session->result_cache_hits;
+                prom->set_value(*value);
+                return prom->get_future();
+            }
+            ++session->result_cache_misses;
+        }
+
+        // Serve fresh responses straight from disk, without a round-trip
+        DiskCache::Ptr cache = ttl.count() > 0 ? disk_cache_ : DiskCache::Ptr();
+        auto cached = make_shared<DiskCache::Entry>();
+        bool have_cached = false;
+        if (cache) {
+            have_cached = cache->get(key, *cached);
+            if (have_cached && cached->fresh()) {
+                try {
+                    T value = decode<T>(cached->body, make_decoder);
+                    results->put(result_key, value,
+                                 cached->expiry - DiskCache::Clock::now());
+                    prom->set_value(value);
+                    return prom->get_future();
+                } catch(io::gzip_error &e) {
+                    cache->remove(key);
+                    have_cached = false;
+                }
+            }
+        }
+
+        // Out of time or cancelled: whatever we have on disk, or nothing
+        if (!session->track(prom)) {
+            if (have_cached) {
+                try {
+                    prom->set_value(decode<T>(cached->body, make_decoder));
+                    return prom->get_future();
+                } catch(io::gzip_error &) {
+                }
+            }
+            prom->set_exception(session->abort_reason());
+            return prom->get_future();
+        }
+
+        // Join an identical request that is already on its way
+        string flight_key = result_key + "|" + typeid(T).name();
+        {
+            lock_guard<mutex> lock(inflight_mutex_);
+            auto it = inflight_.find(flight_key);
+            if (it != inflight_.end()) {
+                auto flight = static_pointer_cast<InFlight<T>>(it->second);
+                flight->waiters.emplace_back(prom);
+                flight->sessions.emplace_back(session);
+                ++session->coalesced;
+                return prom->get_future();
+            }
+            auto flight = make_shared<InFlight<T>>();
+            flight->waiters.emplace_back(prom);
+            flight->sessions.emplace_back(session);
+            inflight_[flight_key] = flight;
+        }
+
+        auto deliver = [this, flight_key](const T &value) {
+            for (const auto &waiter : finish<T>(flight_key)->waiters) {
+                waiter->set_value(value);
+            }
+        };
+        auto fail = [this, flight_key](exception_ptr e) {
+            for (const auto &waiter : finish<T>(flight_key)->waiters) {
+                waiter->set_exception(e);
+            }
+        };
+
+        http::Request::Handler handler;
+        handler.on_progress([this, flight_key](const http::Request::Progress&) {
+            // Keep going while anyone still waits for the result
+            lock_guard<mutex> lock(inflight_mutex_);
+            auto it = inflight_.find(flight_key);
+            if (it != inflight_.end()) {
+                auto flight = static_pointer_cast<InFlight<T>>(it->second);
+                for (size_t i = 0; i < flight->waiters.size(); ++i) {
+                    if (!flight->waiters[i]->settled()
+                            && !flight->sessions[i]->aborted()) {
+                        return http::Request::Progress::Next::continue_operation;
+                    }
+                }
+            }
+            return http::Request::Progress::Next::abort_operation;
+        });
+        handler.on_error([deliver, fail, make_decoder, cached, have_cached](const net::Error& e)
+        {
+            // A stale response is better than none when we are offline
+            if (have_cached) {
+                try {
+                    deliver(decode<T>(cached->body, make_decoder));
+                    return;
+                } catch(io::gzip_error &) {
+                }
+            }
+            fail(make_exception_ptr(e));
+        });
+        // Inflate and parse while the rest of the body is still arriving
+        auto download = make_shared<Download<T>>(make_decoder);
+        download->keep_body = bool(cache);
+        http::StreamingRequest::DataHandler data_handler(
+                [download](const string &data) {
+                    download->write(data);
+                });
+
+        handler.on_response(
+                [deliver,fail,make_decoder,session,cache,cached,have_cached,results,key,result_key,ttl,download](const http::Response& response)
+                {
+                    chrono::seconds fresh_for = response_ttl(response, ttl);
+
+                    // Our copy is still good: reuse its parse if we have it
+                    if (response.status == http::Status::not_modified && have_cached) {
+                        ++session->revalidated;
+                        cached->stored = DiskCache::Clock::now();
+                        cached->expiry = cached->stored + fresh_for;
+                        cache->put(key, *cached);
+
+                        try {
+                            auto value = results->template get<T>(result_key, true);
+                            T result = value ? *value : decode<T>(cached->body, make_decoder);
+                            results->put(result_key, result, fresh_for);
+                            deliver(result);
+                        } catch(io::gzip_error &e) {
+                            fail(make_exception_ptr(e));
+                        }
+                        return;
+                    }
+
+                    if (!download->received) {
+                        download->write(response.body);
+                    }
+
+                    //Soundcloud api return 404 if track is not in auth user's favorite list
+                    //or auth user is not following one certain user.
+//                    if (response.status != http::Status::ok) {
+//                        fail(make_exception_ptr(domain_error(root["error"].asString())));
+//                    } else {
+                        try {
+                            T value = download->finish();
+
+                            bool keep = response.status == http::Status::ok
+                                    && storable(response);
+                            if (cache && keep && !download->body.empty()) {
+                                DiskCache::Entry entry;
+                                entry.body = move(download->body);
+                                entry.etag = header_value(response.header, "ETag");
+                                entry.last_modified = header_value(response.header, "Last-Modified");
+                                entry.stored = DiskCache::Clock::now();
+                                entry.expiry = entry.stored + fresh_for;
+                                cache->put(key, entry);
+                            }
+
+                            if (results && keep) {
+                                results->put(result_key, value, fresh_for);
+                            }
+                            deliver(value);
+                        } catch(io::gzip_error &) {
+                            // Error pages often come without gzip or JSON
+                            fail(response.status == http::Status::ok ?
+                                    current_exception() :
+                                    make_exception_ptr(StatusError(response.status)));
+                        } catch(...) {
+                            // Never leave the request in the in-flight table
+                            fail(current_exception());
+                        }
+//                    }
+                });
+
+        get(snapshot->config, path, parameters,
+            have_cached ? cached.get() : nullptr, handler, data_handler);
+
+        return prom->get_future();
+    }
+
+    template<typename T>
+    future<T> async_post(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
+            const net::Uri::QueryParameters &parameters,
+            const std::string &postmsg,
+            const std::string &content_type,
+            const function<T(const json::Value &root)> &func) {
+        auto prom = make_shared<Pending<T>>();
+        if (!session->track(prom)) {
+            prom->set_exception(session->abort_reason());
+            return prom->get_future();
+        }
+
+        http::Request::Handler handler;
+        handler.on_progress(
+                bind(&Client::Priv::progress_report, session, placeholders::_1));
+        handler.on_error([prom](const net::Error& e)
+        {
+            prom->set_exception(make_exception_ptr(e));
+        });
+        handler.on_response(
+                [prom,func](const http::Response& response)
+                {
+                    json::Value root;
+                    json::Reader reader;
+                    reader.parse(response.body, root);
+
+                    if (response.status != http::Status::ok && 
+						response.status != http::Status::created) {
+                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
+                    } else {
+                        prom->set_value(func(root));
+                    }
+                });
+
+        post(session, path, parameters, postmsg, content_type, handler);
+
+        return prom->get_future();
+    }
+    
+    template<typename T>
+    future<T> async_put(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
+            const net::Uri::QueryParameters &parameters,
+            const std::string &msg,
+            const function<T(const json::Value &root)> &func) {
+        auto prom = make_shared<Pending<T>>();
+        if (!session->track(prom)) {
+            prom->set_exception(session->abort_reason());
+            return prom->get_future();
+        }
+
+        http::Request::Handler handler;
+        handler.on_progress(
+                bind(&Client::Priv::progress_report, session, placeholders::_1));
+        handler.on_error([prom](const net::Error& e)
+        {
+            prom->set_exception(make_exception_ptr(e));
+        });
+        handler.on_response(
+                [prom,func](const http::Response& response)
+                {		  
+                    json::Value root;
+                    json::Reader reader;
+                    reader.parse(response.body, root);
+
+                    if (response.status != http::Status::created &&
+                        response.status != http::Status::ok) {
+                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
+                    } else {
+                        prom->set_value(func(root));
+                    }
+                });
+
+        put(session, path, parameters, msg, handler);
+
+        return prom->get_future();
+    }
+
+    template<typename T>
+    future<T> async_del(const shared_ptr<Session> &session,
+            const net::Uri::Path &path,
+            const net::Uri::QueryParameters &parameters,
+            const function<T(const json::Value &root)> &func) {
+        auto prom = make_shared<Pending<T>>();
+        if (!session->track(prom)) {
+            prom->set_exception(session->abort_reason());
+            return prom->get_future();
+        }
+
+        http::Request::Handler handler;
+        handler.on_progress(
+                bind(&Client::Priv::progress_report, session, placeholders::_1));
+        handler.on_error([prom](const net::Error& e)
+        {
+            prom->set_exception(make_exception_ptr(e));
+        });
+        handler.on_response(
+                [prom,func](const http::Response& response)
+                {
+                    json::Value root;
+                    json::Reader reader;
+                    reader.parse(response.body, root);
+
+                    if (response.status != http::Status::created &&
+                            response.status != http::Status::ok) {
+                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
+                    } else {
+                        prom->set_value(func(root));
+                    }
+                });
+
+        del(session, path, parameters, handler);
+
+        return prom->get_future();
+    }
+
+    /**
+     * A track list fetched page by page along its cursors, one request at
+     * a time and at most one page ahead of the caller
+     */
+    class TrackPages: public Client::TrackPager,
+            public enable_shared_from_this<TrackPages> {
+    public:
+        typedef function<Decoder<deque<Track>>::Ptr()> ItemsFactory;
+
+        /**
+         * Page through the list at @a path, whose items are decoded by the
+         * decoders from @a make_items, and request the first page
+         */
+        static shared_ptr<TrackPages> create(const shared_ptr<Priv> &priv,
+                const shared_ptr<Session> &session,
+                const net::Uri::Path &path,
+                const net::Uri::QueryParameters &parameters,
+                const ItemsFactory &make_items,
+                const string &variant) {
+            shared_ptr<TrackPages> pages(new TrackPages(priv, session, path,
+                    parameters, make_items, variant));
+            pages->fetch();
+            return pages;
+        }
+
+        future<deque<Track>> next() override {
+            future<deque<Track>> page;
+            {
+                lock_guard<mutex> lock(mutex_);
+                size_t index = handed_out_++;
+                Slot &slot = slots_[index];
+                page = slot.page.get_future();
+                if (slot.settled) {
+                    slots_.erase(index);
+                } else if (end_ && index >= requested_) {
+                    slot.page.set_value(deque<Track>());
+                    slots_.erase(index);
+                }
+            }
+            // Now that this page is taken, the one after it may go out
+            fetch();
+            return page;
+        }
+
+        bool exhausted() const override {
+            lock_guard<mutex> lock(mutex_);
+            return end_ && handed_out_ >= requested_;
+        }
+
+    protected:
+        struct Slot {
+            promise<deque<Track>> page;
+
+            bool settled = false;
+        };
+
+        TrackPages(const shared_ptr<Priv> &priv,
+                   const shared_ptr<Session> &session,
+                   const net::Uri::Path &path,
+                   const net::Uri::QueryParameters &parameters,
+                   const ItemsFactory &make_items,
+                   const string &variant) :
+                priv_(priv), session_(session), path_(path),
+                parameters_(parameters), make_items_(make_items),
+                variant_(variant) {
+        }
+
+        /**
+         * Request the next page, if its cursor is known and the caller
+         * has caught up
+         */
+        void fetch() {
+            net::Uri::Path path = path_;
+            net::Uri::QueryParameters parameters = parameters_;
+            size_t index;
+            {
+                lock_guard<mutex> lock(mutex_);
+                if (end_ || fetching_ || requested_ > handed_out_) {
+                    return;
+                }
+                if (requested_ > 0 && !parse_href(cursor_, path, parameters)) {
+                    cerr << "Could not follow cursor " << cursor_ << endl;
+                    end();
+                    return;
+                }
+                index = requested_++;
+                fetching_ = true;
+            }
+
+            // Decoded on the HTTP worker, which must not wait for us
+            weak_ptr<TrackPages> weak(shared_from_this());
+            ItemsFactory make_items = make_items_;
+            priv_->async_decode<Page<Track>>(session_, path, parameters,
+                [make_items]() {
+                    return make_shared<PageDecoder<Track>>(make_items());
+                }, variant_,
+                [weak, index](const Page<Track> *page, exception_ptr error) {
+                    if (auto pages = weak.lock()) {
+                        pages->arrived(index, page, error);
+                    }
+                });
+        }
+
+        void arrived(size_t index, const Page<Track> *page,
+                     exception_ptr error) {
+            {
+                lock_guard<mutex> lock(mutex_);
+                fetching_ = false;
+                Slot &slot = slots_[index];
+                if (page) {
+                    deque<Track> tracks;
+                    for (const auto &track : page->items) {
+                        if (seen_.insert(track.id()).second) {
+                            tracks.emplace_back(track);
+                        }
+                    }
+                    slot.page.set_value(move(tracks));
+                    cursor_ = page->next_href;
+                } else {
+                    slot.page.set_exception(error);
+                }
+                if (index < handed_out_) {
+                    slots_.erase(index);
+                } else {
+                    slot.settled = true;
+                }
+                if (!page || cursor_.empty()) {
+                    end();
+                }
+            }
+            fetch();
+        }
+
+        /**
+         * No more pages: those already asked for come out empty. Must be
+         * called with mutex_ held.
+         */
+        void end() {
+            end_ = true;
+            for (auto it = slots_.lower_bound(requested_); it != slots_.end();) {
+                it->second.page.set_value(deque<Track>());
+                it = slots_.erase(it);
+            }
+        }
+
+        shared_ptr<Priv> priv_;
+
+        shared_ptr<Session> session_;
+
+        net::Uri::Path path_;
+
+        net::Uri::QueryParameters parameters_;
+
+        ItemsFactory make_items_;
+
+        string variant_;
+
+        /// Pages requested but not handed out yet, or the other way round
+        map<size_t, Slot> slots_;
+
+        /// Pages requested so far, and handed out by next()
+        size_t requested_ = 0;
+
+        size_t handed_out_ = 0;
+
+        bool fetching_ = false;
+
+        bool end_ = false;
+
+        /// Where the page after the last one received is
+        string cursor_;
+
+        /// IDs of the tracks handed out already
+        set<unsigned int> seen_;
+
+        mutable mutex mutex_;
+    };
+
+    /**
+     * The first @a limit tracks of the activity stream.
+     *
+     * Once the stream was fetched, only the activities newer than it are
+     * asked for, along its future_href cursor, and merged in front. It is
+     * fetched in full again when there is no usable cursor: the first
+     * time, for another user, for a longer list, or once the cursor has
+     * expired.
+     */
+    future<deque<Track>> stream(const shared_ptr<Session> &session,
+            unsigned int limit, const Client::TrackChannel &channel) {
+        auto result = make_shared<promise<deque<Track>>>();
+        future<deque<Track>> tracks = result->get_future();
+        string owner = this->owner(session);
+
+        net::Uri::Path path;
+        net::Uri::QueryParameters params;
+        bool incremental = false;
+        {
+            lock_guard<mutex> lock(stream_mutex_);
+            incremental = owner == stream_.owner && limit <= stream_.limit
+                    && parse_href(stream_.future_href, path, params);
+        }
+        if (!incremental) {
+            refresh_stream(session, owner, limit, channel, result);
+            return tracks;
+        }
+
+        async_decode<Page<Track>>(session, path, params,
+            []() {
+                return make_shared<PageDecoder<Track>>(
+                        make_shared<ActivityListDecoder<Track>>("track"));
+            }, "page",
+            [this, session, owner, limit, channel, result](
+                    const Page<Track> *page, exception_ptr error) {
+                if ((page && page->future_href.empty())
+                        || (!page && refused(error))) {
+                    // Not a page of activities: the cursor is gone
+                    refresh_stream(session, owner, limit, channel, result);
+                    return;
+                }
+
+                unique_lock<mutex> lock(stream_mutex_);
+                if (owner != stream_.owner) {
+                    // Someone else's stream was fetched in the meantime
+                    lock.unlock();
+                    refresh_stream(session, owner, limit, channel, result);
+                    return;
+                }
+                // Without a connection, time or a working server, what we
+                // have will do
+                if (page) {
+                    deque<Track> merged;
+                    set<unsigned int> seen;
+                    auto add = [&merged, &seen, this](const deque<Track> &tracks) {
+                        for (const auto &track : tracks) {
+                            if (merged.size() < stream_.limit
+                                    && seen.insert(track.id()).second) {
+                                merged.emplace_back(track);
+                            }
+                        }
+                    };
+                    add(page->items);
+                    add(stream_.tracks);
+                    stream_.tracks = move(merged);
+                    stream_.future_href = page->future_href;
+                }
+                size_t count = min<size_t>(limit, stream_.tracks.size());
+                result->set_value(deque<Track>(stream_.tracks.begin(),
+                        stream_.tracks.begin() + count));
+            });
+        return tracks;
+    }
+
+    /**
+     * Fetch the first @a limit tracks of the stream in full, and keep them
+     */
+    void refresh_stream(const shared_ptr<Session> &session,
+            const string &owner, unsigned int limit,
+            const Client::TrackChannel &channel,
+            const shared_ptr<promise<deque<Track>>> &result) {
+        net::Uri::QueryParameters params {
+            { "limit", std::to_string(limit) }
+        };
+        async_decode<Page<Track>>(session,
+            { "me", "activities", "tracks", "affiliated.json" }, params,
+            [channel]() {
+                return make_shared<PageDecoder<Track>>(
+                        make_shared<ActivityListDecoder<Track>>("track", channel));
+            }, "page",
+            [this, owner, limit, result](const Page<Track> *page,
+                                         exception_ptr error) {
+                if (!page) {
+                    result->set_exception(error);
+                    return;
+                }
+                {
+                    lock_guard<mutex> lock(stream_mutex_);
+                    stream_.owner = owner;
+                    stream_.tracks = page->items;
+                    stream_.future_href = page->future_href;
+                    stream_.limit = limit;
+                }
+                result->set_value(page->items);
+            });
+    }
+
+    /**
+     * The @a limit hottest tracks of @a genre, from its candidate pool.
+     *
+     * A pool that was fetched already answers straight away, even when it
+     * is being fetched again because it is old. Only the first request
+     * for a genre has to wait, until the pool is in or @a session is
+     * cancelled; the fetch itself goes on regardless.
+     */
+    future<deque<Track>> hot_tracks(const shared_ptr<Session> &session,
+                                    const string &genre, size_t limit) {
+        auto result = make_shared<Pending<deque<Track>>>();
+        future<deque<Track>> tracks = result->get_future();
+        if (!session->track(result)) {
+            result->set_exception(session->abort_reason());
+            return tracks;
+        }
+
+        bool refresh = false;
+        {
+            lock_guard<mutex> lock(pools_mutex_);
+            Pool &pool = pools_[genre];
+            if (!pool.refreshing && (pool.tracks.empty()
+                    || chrono::steady_clock::now() - pool.fetched > HOT_POOL_MAX_AGE)) {
+                pool.refreshing = true;
+                refresh = true;
+            }
+            if (pool.tracks.empty()) {
+                pool.waiting.emplace_back(result, limit);
+            } else {
+                result->set_value(hottest(pool.tracks, limit,
+                                          chrono::system_clock::now()));
+            }
+        }
+        if (refresh) {
+            refresh_pool(genre);
+        }
+        return tracks;
+    }
+
+    /**
+     * Fetch the pool of @a genre again, all pages at once, on its own
+     * session so that no query cancels it
+     */
+    void refresh_pool(const string &genre) {
+        auto session = make_shared<Session>();
+        session->deadline = (chrono::steady_clock::now()
+                + HOT_POOL_BUDGET).time_since_epoch().count();
+
+        struct Fetch {
+            vector<deque<Track>> pages;
+
+            size_t remaining = HOT_POOL_PAGES;
+
+            exception_ptr error;
+
+            mutex guard;
+        };
+        auto fetch = make_shared<Fetch>();
+        fetch->pages.resize(HOT_POOL_PAGES);
+
+        for (unsigned int page = 0; page < HOT_POOL_PAGES; ++page) {
+            net::Uri::QueryParameters params {
+                { "genres", genre },
+                { "limit", std::to_string(PAGE_LIMIT) },
+                { "offset", std::to_string(page * PAGE_LIMIT) }
+            };
+            async_decode<deque<Track>>(session, { "tracks.json" }, params,
+                []() {
+                    return make_shared<ListDecoder<Track>>("track");
+                }, string(),
+                [this, genre, fetch, page](const deque<Track> *tracks,
+                                           exception_ptr error) {
+                    {
+                        lock_guard<mutex> lock(fetch->guard);
+                        if (tracks) {
+                            fetch->pages[page] = *tracks;
+                        } else if (!fetch->error) {
+                            fetch->error = error;
+                        }
+                        if (--fetch->remaining > 0) {
+                            return;
+                        }
+                    }
+                    fill_pool(genre, fetch->pages, fetch->error);
+                });
+        }
+    }
+
+    /**
+     * Replace the pool of @a genre with the fetched @a pages, unless they
+     * are all empty, and answer whoever waited for it
+     */
+    void fill_pool(const string &genre, const vector<deque<Track>> &pages,
+                   exception_ptr error) {
+        deque<Track> tracks;
+        set<unsigned int> seen;
+        for (const auto &page : pages) {
+            for (const auto &track : page) {
+                if (seen.insert(track.id()).second) {
+                    tracks.emplace_back(track);
+                }
+            }
+        }
+
+        vector<pair<Pending<deque<Track>>::Ptr, size_t>> waiting;
+        {
+            lock_guard<mutex> lock(pools_mutex_);
+            Pool &pool = pools_[genre];
+            pool.refreshing = false;
+            if (!tracks.empty()) {
+                pool.tracks = move(tracks);
+                pool.fetched = chrono::steady_clock::now();
+            }
+            tracks = pool.tracks;
+            waiting.swap(pool.waiting);
+        }
+
+        auto now = chrono::system_clock::now();
+        for (const auto &waiter : waiting) {
+            if (!tracks.empty() || !error) {
+                waiter.first->set_value(hottest(tracks, waiter.second, now));
+            } else {
+                waiter.first->set_exception(error);
+            }
+        }
+    }
+
+    /**
+     * Look up @a ids in chunks of TRACK_IDS_LIMIT, all at once. The chunks
+     * are made from the sorted IDs, so that the same tracks asked for in
+     * another order still hit the caches.
+     */
+    future<Client::TrackLookup> tracks(const shared_ptr<Session> &session,
+                                       const vector<unsigned int> &ids) {
+        struct Lookup {
+            vector<unsigned int> requested;
+
+            map<unsigned int, Track> found;
+
+            size_t remaining = 0;
+
+            exception_ptr error;
+
+            promise<Client::TrackLookup> result;
+
+            mutex guard;
+        };
+        auto lookup = make_shared<Lookup>();
+        lookup->requested = ids;
+        future<Client::TrackLookup> result = lookup->result.get_future();
+
+        vector<unsigned int> unique_ids(ids);
+        sort(unique_ids.begin(), unique_ids.end());
+        unique_ids.erase(unique(unique_ids.begin(), unique_ids.end()),
+                         unique_ids.end());
+        lookup->remaining = (unique_ids.size() + TRACK_IDS_LIMIT - 1)
+                / TRACK_IDS_LIMIT;
+        if (lookup->remaining == 0) {
+            lookup->result.set_value(Client::TrackLookup());
+            return result;
+        }
+
+        // The last chunk to finish puts the result together
+        auto chunk_done = [lookup](const deque<Track> *tracks,
+                                   exception_ptr error) {
+            lock_guard<mutex> lock(lookup->guard);
+            if (tracks) {
+                for (const auto &track : *tracks) {
+                    lookup->found.emplace(track.id(), track);
+                }
+            } else if (!lookup->error) {
+                lookup->error = error;
+            }
+            if (--lookup->remaining > 0) {
+                return;
+            }
+            if (lookup->error) {
+                lookup->result.set_exception(lookup->error);
+                return;
+            }
+            Client::TrackLookup complete;
+            for (unsigned int id : lookup->requested) {
+                auto it = lookup->found.find(id);
+                if (it != lookup->found.end()) {
+                    complete.tracks.emplace_back(it->second);
+                } else {
+                    complete.missing.emplace_back(id);
+                }
+            }
+            lookup->result.set_value(move(complete));
+        };
+
+        for (size_t start = 0; start < unique_ids.size();
+                start += TRACK_IDS_LIMIT) {
+            size_t end = min(start + TRACK_IDS_LIMIT, unique_ids.size());
+            string chunk;
+            for (size_t i = start; i < end; ++i) {
+                chunk += (chunk.empty() ? "" : ",") + to_string(unique_ids[i]);
+            }
+            net::Uri::QueryParameters params {
+                { "ids", chunk }
+            };
+            async_decode<deque<Track>>(session, { "tracks.json" }, params,
+                []() {
+                    return make_shared<ListDecoder<Track>>("track");
+                }, string(), chunk_done);
+        }
+        return result;
+    }
+
+    /**
+     * Identifies the user the credentials of @a session belong to, or is
+     * empty if there are none
+     */
+    string owner(const shared_ptr<Session> &session) {
+        ConfigSnapshot::Ptr snapshot = config(session);
+        if (!snapshot->config.authenticated) {
+            return string();
+        }
+        return DiskCache::digest(snapshot->config.access_token);
     }
 
+    /**
+     * Answer whether @a id is in @a index, without a round-trip. Returns
+     * an invalid future if the index does not know (yet).
+     *
+     * The index is synced in the background from the list of resources at
+     * @a path when that is due.
+     */
     template<typename T>
-    future<T> async_get(const net::Uri::Path &path,
-            const net::Uri::QueryParameters &parameters,
-            const function<T(const json::Value &root)> &func) {
-        auto prom = make_shared<promise<T>>();
+    future<bool> lookup(const shared_ptr<Session> &session,
+            const IdIndex::Ptr &index, const net::Uri::Path &path,
+            const string &kind, const string &id,
+            Outbox::Action add, Outbox::Action remove) {
+        future<bool> answer;
+        string owner = this->owner(session);
+        if (owner.empty()) {
+            return answer;
+        }
+        if (index->start_sync(owner)) {
+            sync<T>(index, owner, path, kind);
+        }
 
-        http::Request::Handler handler;
-        handler.on_progress(
-                bind(&Client::Priv::progress_report, this, placeholders::_1));
-        handler.on_error([prom](const net::Error& e)
-        {
-            prom->set_exception(make_exception_ptr(e));
-        });
-        handler.on_response(
-                [prom,func](const http::Response& response)
-                {
-                    string decompressed;
+        // Writes that are still queued are what the user expects to see
+        promise<bool> prom;
+        bool queued;
+        if (outbox_->state(owner, id, add, remove, queued)) {
+            prom.set_value(queued);
+            return prom.get_future();
+        }
+
+        unsigned int numeric;
+        if (!parse_id(id, numeric)) {
+            return answer;
+        }
+        IdIndex::Answer known = index->lookup(owner, numeric);
+        if (known == IdIndex::Answer::unknown) {
+            return answer;
+        }
+        prom.set_value(known == IdIndex::Answer::yes);
+        return prom.get_future();
+    }
 
-                    if(!response.body.empty()) {
+    /**
+     * Fill @a index from the list at @a path, on its own session so that
+     * cancelling a query does not interrupt it
+     */
+    template<typename T>
+    void sync(const IdIndex::Ptr &index, const string &owner,
+              const net::Uri::Path &path, const string &kind) {
+        auto session = make_shared<Session>();
+        session->deadline = (chrono::steady_clock::now()
+                + RELATIONSHIPS_SYNC_BUDGET).time_since_epoch().count();
+
+        net::Uri::QueryParameters params {
+            { "limit", to_string(RELATIONSHIPS_SYNC_LIMIT) }
+        };
+        // Filed on the thread that settles the request, without blocking it
+        auto finished = make_shared<promise<void>>();
+        future<void> done = finished->get_future();
+        async_decode<deque<T>>(session, path, params,
+                [kind]() {
+                    return make_shared<ListDecoder<T>>(kind);
+                }, string(),
+                [index, owner, kind, finished](const deque<T> *list,
+                                               exception_ptr error) {
+                    if (list) {
+                        vector<unsigned int> ids;
+                        ids.reserve(list->size());
+                        for (const auto &item : *list) {
+                            ids.emplace_back(item.id());
+                        }
+                        index->synced(owner, move(ids),
+                                      list->size() < RELATIONSHIPS_SYNC_LIMIT);
+                    } else {
                         try {
-                            io::filtering_ostream os;
-                            os.push(io::gzip_decompressor());
-                            os.push(io::back_inserter(decompressed));
-                            os << response.body;
-                            boost::iostreams::close(os);
-                        } catch(io::gzip_error &e) {
-                            prom->set_exception(make_exception_ptr(e));
-                            return;
+                            rethrow_exception(error);
+                        } catch (exception &e) {
+                            cerr << "Could not sync " << kind << " IDs: "
+                                 << e.what() << endl;
+                        } catch (...) {
+                            cerr << "Could not sync " << kind << " IDs" << endl;
                         }
+                        index->sync_failed(owner);
                     }
-
-                    json::Value root;
-                    json::Reader reader;
-                    reader.parse(decompressed, root);
-
-                    //Soundcloud api return 404 if track is not in auth user's favorite list
-                    //or auth user is not following one certain user.
-//                    if (response.status != http::Status::ok) {
-//                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
-//                    } else {
-                        prom->set_value(func(root));
-//                    }
+                    finished->set_value();
                 });
 
-        get(path, parameters, handler);
+        lock_guard<mutex> lock(syncs_mutex_);
+        syncs_.erase(remove_if(syncs_.begin(), syncs_.end(),
+                [](const pair<shared_ptr<Session>, future<void>> &sync) {
+                    return sync.second.wait_for(chrono::seconds(0))
+                            == future_status::ready;
+                }), syncs_.end());
+        syncs_.emplace_back(session, move(done));
+    }
 
-        return prom->get_future();
+    /**
+     * Result function for a write that puts @a id in @a index, or takes it
+     * out, once the server accepted it
+     */
+    function<bool(const json::Value &root)> record(
+            const shared_ptr<Session> &session, const IdIndex::Ptr &index,
+            const string &id, bool present) {
+        string owner = this->owner(session);
+        return [index, owner, id, present](const json::Value &root) {
+            auto results = is_successful<bool>(root);
+            unsigned int numeric;
+            if (results && !owner.empty() && parse_id(id, numeric)) {
+                if (present) {
+                    index->add(owner, numeric);
+                } else {
+                    index->remove(owner, numeric);
+                }
+            }
+            return results;
+        };
     }
 
-    template<typename T>
-    future<T> async_post(const net::Uri::Path &path,
-            const net::Uri::QueryParameters &parameters,
-            const std::string &postmsg,
-            const std::string &content_type,
-            const function<T(const json::Value &root)> &func) {
-        auto prom = make_shared<promise<T>>();
+    /**
+     * Drop the cached responses of a GET request, once a write made them
+     * out of date
+     */
+    void forget(const shared_ptr<Session> &session,
+                const net::Uri::Path &path,
+                const net::Uri::QueryParameters &parameters) {
+        string key = cache_key(config(session)->config, path, parameters);
+        result_cache_->remove(key + "|");
+        if (disk_cache_) {
+            disk_cache_->remove(key);
+        }
+    }
 
-        http::Request::Handler handler;
-        handler.on_progress(
-                bind(&Client::Priv::progress_report, this, placeholders::_1));
-        handler.on_error([prom](const net::Error& e)
-        {
-            prom->set_exception(make_exception_ptr(e));
-        });
-        handler.on_response(
-                [prom,func](const http::Response& response)
-                {
-                    json::Value root;
-                    json::Reader reader;
-                    reader.parse(response.body, root);
+    /**
+     * Drop the cached responses of every GET request for @a path, such as
+     * all the pages of a list, whatever their size or cursor
+     */
+    void forget_all(const shared_ptr<Session> &session,
+                    const net::Uri::Path &path) {
+        string prefix = cache_prefix(config(session)->config, path);
+        result_cache_->remove_prefix(prefix);
+        if (disk_cache_) {
+            disk_cache_->remove_prefix(prefix);
+        }
+    }
 
-                    if (response.status != http::Status::ok && 
-						response.status != http::Status::created) {
-                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
-                    } else {
-                        prom->set_value(func(root));
-                    }
-                });
+    /**
+     * Queue a write for the sender, and report it done straight away.
+     *
+     * Only a logged in user's writes are queued, under their account;
+     * without one the write fails at once. A write already queued waits
+     * in the outbox if the user logs out before it is sent.
+     */
+    future<bool> enqueue(const shared_ptr<Session> &session,
+            Outbox::Action action, const string &target,
+            const string &body = string()) {
+        promise<bool> prom;
+        Outbox::Entry entry;
+        entry.owner = owner(session);
+        if (entry.owner.empty()) {
+            prom.set_exception(make_exception_ptr(domain_error("Not logged in")));
+            return prom.get_future();
+        }
+        entry.action = action;
+        entry.target = target;
+        entry.body = body;
+        outbox_->push(entry);
+
+        // Someone is logged in, which may also let parked writes go
+        unpark();
+        prom.set_value(true);
+        return prom.get_future();
+    }
 
-        post(path, parameters, postmsg, content_type, handler);
+    /**
+     * Issue the request for a queued write
+     */
+    future<bool> request(const shared_ptr<Session> &session,
+                         const Outbox::Entry &entry) {
+        net::Uri::QueryParameters params;
+        switch (entry.action) {
+        case Outbox::Action::like:
+            return async_put<bool>(session,
+                { "me", "favorites", entry.target }, params, "",
+                record(session, favorites_, entry.target, true));
+        case Outbox::Action::unlike:
+            return async_del<bool>(session,
+                { "me", "favorites", entry.target }, params,
+                record(session, favorites_, entry.target, false));
+        case Outbox::Action::follow:
+            return async_put<bool>(session,
+                { "me", "followings", entry.target }, params, "",
+                record(session, followings_, entry.target, true));
+        case Outbox::Action::unfollow:
+            return async_del<bool>(session,
+                { "me", "followings", entry.target }, params,
+                record(session, followings_, entry.target, false));
+        case Outbox::Action::comment:
+            break;
+        }
 
-        return prom->get_future();
+        string postbody = "<comment><body>"+ entry.body + "</body></comment>";
+        std::string content_type = "application/xml";
+        return async_post<bool>(session,
+            { "tracks", entry.target, "comments.json"}, params, postbody,
+            content_type,
+            [](const json::Value &root) {
+                auto results = is_successful<bool>(root);
+                return results;
+        });
     }
-    
-    template<typename T>
-    future<T> async_put(const net::Uri::Path &path,
-            const net::Uri::QueryParameters &parameters,
-            const std::string &msg,
-            const function<T(const json::Value &root)> &func) {
-        auto prom = make_shared<promise<T>>();
 
-        http::Request::Handler handler;
-        handler.on_progress(
-                bind(&Client::Priv::progress_report, this, placeholders::_1));
-        handler.on_error([prom](const net::Error& e)
+    /**
+     * Wake the sender up, because a user may have logged in
+     */
+    void unpark() {
+        lock_guard<mutex> lock(sender_mutex_);
+        parked_ = false;
+        ++account_changes_;
+        sender_cond_.notify_all();
+    }
+
+    /**
+     * Send one write, and take it off the outbox if that worked or will
+     * never work. Without a logged in user the sender is parked, the
+     * write keeping its place, until unpark().
+     */
+    void send(const Outbox::Entry &entry) {
+        auto session = make_shared<Session>();
+        session->deadline = (chrono::steady_clock::now()
+                + OUTBOX_SEND_BUDGET).time_since_epoch().count();
+        unsigned int account_changes;
         {
-            prom->set_exception(make_exception_ptr(e));
-        });
-        handler.on_response(
-                [prom,func](const http::Response& response)
-                {		  
-                    json::Value root;
-                    json::Reader reader;
-                    reader.parse(response.body, root);
+            lock_guard<mutex> lock(sender_mutex_);
+            if (stopping_) {
+                return;
+            }
+            sending_ = session;
+            account_changes = account_changes_;
+        }
 
-                    if (response.status != http::Status::created &&
-                        response.status != http::Status::ok) {
-                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
-                    } else {
-                        prom->set_value(func(root));
-                    }
-                });
+        // Every way out goes through the reset of sending_ below
+        bool sent = false;
+        bool logged_out = false;
+        bool foreign = false;
+        string owner = this->owner(session);
+        if (owner.empty()) {
+            // Wait for the user to log in again
+            logged_out = true;
+        } else if (owner != entry.owner) {
+            foreign = true;
+        } else {
+            try {
+                sent = request(session, entry).get();
+            } catch (exception &e) {
+                cerr << "Could not send queued write: " << e.what() << endl;
+            }
+        }
 
-        put(path, parameters, msg, handler);
+        {
+            lock_guard<mutex> lock(sender_mutex_);
+            sending_.reset();
+            if (stopping_) {
+                // Interrupted, it is sent again on the next start
+                return;
+            }
+            parked_ = logged_out && account_changes == account_changes_;
+        }
 
-        return prom->get_future();
+        if (foreign) {
+            cerr << "Dropping a write queued by another account" << endl;
+            outbox_->remove(entry.sequence);
+        } else if (sent) {
+            if (entry.action == Outbox::Action::comment) {
+                forget(session, { "tracks", entry.target, "comments.json" },
+                       net::Uri::QueryParameters());
+            } else if (entry.action == Outbox::Action::like
+                    || entry.action == Outbox::Action::unlike) {
+                forget_all(session, { "me", "favorites.json" });
+            }
+            outbox_->remove(entry.sequence);
+        } else if (logged_out) {
+            // Not an attempt: it waits for the login without a backoff
+        } else if (entry.attempts + 1 >= OUTBOX_MAX_ATTEMPTS) {
+            cerr << "Giving up on queued write after " << OUTBOX_MAX_ATTEMPTS
+                 << " attempts" << endl;
+            outbox_->remove(entry.sequence);
+        } else {
+            chrono::seconds backoff = min<chrono::seconds>(OUTBOX_MAX_RETRY,
+                    OUTBOX_RETRY * (1 << min(entry.attempts, 16u)));
+            outbox_->retry(entry.sequence, chrono::steady_clock::now() + backoff);
+        }
     }
 
-    template<typename T>
-    future<T> async_del(const net::Uri::Path &path,
-            const net::Uri::QueryParameters &parameters,
-            const function<T(const json::Value &root)> &func) {
-        auto prom = make_shared<promise<T>>();
-
-        http::Request::Handler handler;
-        handler.on_progress(
-                bind(&Client::Priv::progress_report, this, placeholders::_1));
-        handler.on_error([prom](const net::Error& e)
-        {
-            prom->set_exception(make_exception_ptr(e));
-        });
-        handler.on_response(
-                [prom,func](const http::Response& response)
-                {
-                    json::Value root;
-                    json::Reader reader;
-                    reader.parse(response.body, root);
+    /**
+     * Body of the sender thread: send the outbox in order, until stopped
+     */
+    void send_outbox() {
+        unique_lock<mutex> lock(sender_mutex_);
+        while (!stopping_) {
+            if (parked_) {
+                sender_cond_.wait(lock);
+                continue;
+            }
+            Outbox::Entry entry;
+            Outbox::Clock::time_point due;
+            if (!outbox_->next(entry, due)) {
+                if (due == Outbox::Clock::time_point::max()) {
+                    sender_cond_.wait(lock);
+                } else {
+                    sender_cond_.wait_until(lock, due);
+                }
+                continue;
+            }
 
-                    if (response.status != http::Status::created &&
-                            response.status != http::Status::ok) {
-                        prom->set_exception(make_exception_ptr(domain_error(root["error"].asString())));
-                    } else {
-                        prom->set_value(func(root));
-                    }
-                });
+            lock.unlock();
+            send(entry);
+            lock.lock();
+        }
+    }
 
-        del(path, parameters, handler);
+    std::string client_id(const shared_ptr<Session> &session) {
+        return config(session)->config.client_id;
+    }
 
-        return prom->get_future();
+    bool authenticated(const shared_ptr<Session> &session) {
+        return config(session)->config.authenticated;
     }
 
-    std::string client_id() {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        update_config();
-        return config_.client_id;
+    bool is_current(const ConfigSnapshot::Ptr &snapshot) const {
+        return snapshot && !config_stale_
+                && chrono::steady_clock::now() < snapshot->expiry;
     }
 
-    bool authenticated() {
-        std::lock_guard<std::mutex> lock(config_mutex_);
-        update_config();
-        return config_.authenticated;
+    /**
+     * Get the current credential snapshot.
+     *
+     * The online accounts lookup costs several D-Bus round-trips, so it is
+     * only repeated when the snapshot expires or the accounts service tells
+     * us something changed. Readers never block on a refresh that is already
+     * in progress; they keep using the previous snapshot until the new one
+     * is published. Only the very first lookup has to be waited for.
+     */
+    ConfigSnapshot::Ptr config(const shared_ptr<Session> &session) {
+        ConfigSnapshot::Ptr snapshot = atomic_load(&config_);
+        if (is_current(snapshot)) {
+            ++session->credential_lookups_saved;
+            return snapshot;
+        }
+
+        std::unique_lock<std::mutex> lock(refresh_mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            if (snapshot) {
+                ++session->credential_lookups_saved;
+                return snapshot;
+            }
+            lock.lock();
+            snapshot = atomic_load(&config_);
+            if (snapshot) {
+                ++session->credential_lookups_saved;
+                return snapshot;
+            }
+        }
+
+        ++session->credential_lookups;
+        config_stale_ = false;
+
+        shared_ptr<ConfigSnapshot> updated = make_shared<ConfigSnapshot>();
+        updated->config = lookup_config();
+        updated->expiry = chrono::steady_clock::now() + CONFIG_TTL;
+        snapshot = updated;
+        atomic_store(&config_, snapshot);
+        if (updated->config.authenticated) {
+            unpark();
+        }
+        return snapshot;
     }
 
-    void update_config() {
-        config_ = Config();
+    /**
+     * Resolve the configuration from the environment and online accounts.
+     * Must be called with refresh_mutex_ held.
+     */
+    Config lookup_config() {
+        Config config;
 
         if (getenv("NETWORK_SCOPE_APIROOT")) {
-            config_.apiroot = getenv("NETWORK_SCOPE_APIROOT");
+            config.apiroot = getenv("NETWORK_SCOPE_APIROOT");
         }
 
         if (getenv("SOUNDCLOUD_SCOPE_IGNORE_ACCOUNTS") != nullptr) {
-            return;
+            return config;
         }
 
         /// TODO: The code commented out below should be uncommented as soon as
@@ -379,131 +2159,186 @@ public:
         ///if (oa_client_ == nullptr) {
             oa_client_.reset(new unity::scopes::OnlineAccountClient(
                 SCOPE_NAME, "sharing", SCOPE_ACCOUNTS_NAME));
+            oa_client_->set_service_update_callback(
+                [this](const unity::scopes::OnlineAccountClient::ServiceStatus &) {
+                    config_stale_ = true;
+                    unpark();
+                });
         ///} else {
         ///    oa_client_->refresh_service_statuses();
         ///}
 
         for (auto const& status : oa_client_->get_service_statuses()) {
             if (status.service_authenticated) {
-                config_.authenticated = true;
-                config_.access_token = status.access_token;
-                config_.client_id = status.client_id;
+                config.authenticated = true;
+                config.access_token = status.access_token;
+                config.client_id = status.client_id;
                 break;
             }
         }
 
-        if (!config_.authenticated) {
+        if (!config.authenticated) {
             std::cerr << "SoundCloud scope is unauthenticated" << std::endl;
         } else {
             std::cerr << "SoundCloud scope is authenticated" << std::endl;
         }
+
+        return config;
     }
 };
 
-Client::Client(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client) :
-        p(new Priv(oa_client)) {
+Client::Client(std::shared_ptr<unity::scopes::OnlineAccountClient> oa_client,
+               const std::string &cache_directory) :
+        p(new Priv(oa_client, cache_directory)), session_(new Session) {
 }
 
-future<deque<Track>> Client::search_tracks(const std::deque<std::pair<SP, std::string>> &parameters) {
-    bool sort = false;
-    net::Uri::QueryParameters params;
-    for(const auto &p: parameters) {
-        switch(p.first){
-        case SP::genre:
-            params.emplace_back(make_pair("genres", p.second));
-            break;
-        case SP::limit:
-            params.emplace_back(make_pair("limit", p.second));
-            break;
-        case SP::order:
-            sort = true;
-            break;
-        case SP::query:
-            params.emplace_back(make_pair("q", p.second));
-            break;
-        }
-    }
+Client::Client(std::shared_ptr<Priv> priv) :
+        p(priv), session_(new Session) {
+}
 
-    return p->async_get<deque<Track>>( { "tracks.json" }, params,
-            [sort](const json::Value &root) {
-                auto results = get_typed_list<Track>("track", root);
-                // Unfortunately SoundCloud doesn't support ordering by hotness any more
-                // See excuse on developer blog: https://developers.soundcloud.com/blog/removing-hotness-param
-                if (sort) {
-                    stable_sort(results.begin(), results.end(), [](const Track &i, const Track &j) {
-                                return i.playback_count() > j.playback_count();
-                            });
-                }
-                return results;
-            });
+Client Client::session() const {
+    return Client(p);
 }
 
-future<deque<Track>> Client::stream_tracks(int limit) {
-    net::Uri::QueryParameters params;
-    if (limit > 0) {
-        params.emplace_back("limit", std::to_string(limit));
-    }
-    return p->async_get<deque<Track>>(
-        { "me", "activities", "tracks", "affiliated.json" }, params,
-        [](const json::Value &root) {
-            return get_typed_activity_list<Track>("track", root);
-        });
+future<deque<Track>> Client::search_tracks(const std::deque<std::pair<SP, std::string>> &parameters,
+                                           const TrackChannel &channel) {
+    bool sort;
+    net::Uri::QueryParameters params = search_parameters(parameters, sort);
+    ListDecoder<Track>::Order order = search_order(sort);
+    return p->async_decode<deque<Track>>(session_,
+        { "tracks.json" }, params,
+            [order, channel]() {
+                return make_shared<ListDecoder<Track>>("track", order, channel);
+            }, sort ? "sorted" : "");
+}
+
+future<deque<Track>> Client::stream_tracks(int limit, const TrackChannel &channel) {
+    return p->stream(session_, limit > 0 ? limit : PAGE_LIMIT, channel);
 }
 
 future<deque<Comment>> Client::track_comments(const std::string &trackid) {
     net::Uri::QueryParameters params;
 
-    return p->async_get<deque<Comment>>( 
+    return p->async_decode<deque<Comment>>(session_,
         { "tracks", trackid, "comments.json"}, params,
-        [](const json::Value &root) {
-            auto results = get_typed_list<Comment>("comment", root);
-            return results;
+        []() {
+            return make_shared<ListDecoder<Comment>>("comment");
         });
 }
 
 future<bool> Client::post_comment(const std::string &trackid,
                                   const std::string &postmsg) {
-    net::Uri::QueryParameters params;
+    return p->enqueue(session_, Outbox::Action::comment, trackid, postmsg);
+}
 
-    string postbody = "<comment><body>"+ postmsg + "</body></comment>";
-    std::string content_type = "application/xml";
-    return p->async_post<bool>(
-        { "tracks", trackid, "comments.json"}, params, postbody, content_type,
-        [](const json::Value &root) {
-            auto results = is_successful<bool>(root);
-            return results;
-    });
+bool Client::comment_queued(const std::string &trackid) {
+    string owner = p->owner(session_);
+    return !owner.empty()
+            && p->outbox_->queued(owner, trackid, Outbox::Action::comment);
 }
 
-std::future<std::deque<Track> > Client::favorite_tracks()
+std::future<std::deque<Track> > Client::favorite_tracks(const TrackChannel &channel)
 {
-    net::Uri::QueryParameters params;
+    net::Uri::QueryParameters params {
+        { "limit", std::to_string(PAGE_LIMIT) }
+    };
 
-    return p->async_get<deque<Track>>(
+    return p->async_decode<deque<Track>>(session_,
         { "me", "favorites.json"}, params,
-        [](const json::Value &root) {
-            return get_typed_list<Track>("track", root);
+        [channel]() {
+            return make_shared<ListDecoder<Track>>("track", ListDecoder<Track>::Order(), channel);
     });
 }
 
 std::future<std::deque<Track> > Client::get_user_tracks(const string &userid,
-                                                        int limit)
+                                                        int limit,
+                                                        const TrackChannel &channel)
 {
     net::Uri::QueryParameters params;
     if (limit > 0) {
         params.emplace_back("limit", std::to_string(limit));
     }
-    return p->async_get<deque<Track>>(
+    return p->async_decode<deque<Track>>(session_,
         { "users", userid, "tracks.json"}, params,
-        [](const json::Value &root) {
-            return get_typed_list<Track>("track", root);
+        [channel]() {
+            return make_shared<ListDecoder<Track>>("track", ListDecoder<Track>::Order(), channel);
         });
 }
 
+Client::TrackPager::Ptr Client::search_track_pages(
+        const std::deque<std::pair<SP, std::string>> &parameters) {
+    bool sort;
+    net::Uri::QueryParameters params = search_parameters(parameters, sort);
+    if (none_of(params.begin(), params.end(),
+                [](const pair<string, string> &param) {
+                    return param.first == "limit";
+                })) {
+        params.emplace_back("limit", std::to_string(PAGE_LIMIT));
+    }
+    params.emplace_back("linked_partitioning", "1");
+    ListDecoder<Track>::Order order = search_order(sort);
+    return Priv::TrackPages::create(p, session_, { "tracks.json" }, params,
+        [order]() {
+            return make_shared<ListDecoder<Track>>("track", order);
+        }, sort ? "page-sorted" : "page");
+}
+
+Client::TrackPager::Ptr Client::stream_track_pages(int limit) {
+    net::Uri::QueryParameters params {
+        { "limit", std::to_string(limit > 0 ? limit : PAGE_LIMIT) }
+    };
+    return Priv::TrackPages::create(p, session_,
+        { "me", "activities", "tracks", "affiliated.json" }, params,
+        []() {
+            return make_shared<ActivityListDecoder<Track>>("track");
+        }, "page");
+}
+
+Client::TrackPager::Ptr Client::favorite_track_pages(int limit) {
+    net::Uri::QueryParameters params {
+        { "limit", std::to_string(limit > 0 ? limit : PAGE_LIMIT) },
+        { "linked_partitioning", "1" }
+    };
+    return Priv::TrackPages::create(p, session_,
+        { "me", "favorites.json" }, params,
+        []() {
+            return make_shared<ListDecoder<Track>>("track");
+        }, "page");
+}
+
+Client::TrackPager::Ptr Client::user_track_pages(const string &userid,
+                                                 int limit) {
+    net::Uri::QueryParameters params {
+        { "limit", std::to_string(limit > 0 ? limit : PAGE_LIMIT) },
+        { "linked_partitioning", "1" }
+    };
+    return Priv::TrackPages::create(p, session_,
+        { "users", userid, "tracks.json" }, params,
+        []() {
+            return make_shared<ListDecoder<Track>>("track");
+        }, "page");
+}
+
+future<deque<Track>> Client::hot_tracks(const string &genre,
+                                        unsigned int limit) {
+    return p->hot_tracks(session_, genre, limit);
+}
+
+future<Client::TrackLookup> Client::get_tracks(const vector<unsigned int> &ids) {
+    return p->tracks(session_, ids);
+}
+
 future<bool> Client::is_fav_track(const std::string &trackid) {
+    future<bool> known = p->lookup<Track>(session_, p->favorites_,
+            { "me", "favorites.json" }, "track", trackid,
+            Outbox::Action::like, Outbox::Action::unlike);
+    if (known.valid()) {
+        return known;
+    }
+
     net::Uri::QueryParameters params;
 
-    return p->async_get<bool>(
+    return p->async_get<bool>(session_,
         { "me", "favorites", trackid}, params,
         [](const json::Value &root) {
             auto results = is_successful<bool>(root);
@@ -512,31 +2347,24 @@ future<bool> Client::is_fav_track(const std::string &trackid) {
 }
 
 future<bool> Client::like_track(const std::string &trackid) {
-    net::Uri::QueryParameters params;
-
-    return p->async_put<bool>(
-        { "me", "favorites", trackid}, params, "",
-        [](const json::Value &root) {
-            auto results = is_successful<bool>(root);
-            return results;
-    });
+    return p->enqueue(session_, Outbox::Action::like, trackid);
 }
 
 future<bool> Client::delete_like_track(const std::string &trackid) {
-    net::Uri::QueryParameters params;
-
-    return p->async_del<bool>(
-        { "me", "favorites", trackid}, params,
-        [](const json::Value &root) {
-            auto results = is_successful<bool>(root);
-            return results;
-    });
+    return p->enqueue(session_, Outbox::Action::unlike, trackid);
 }
 
 std::future<bool> Client::is_user_follower(const string &userid) {
+    future<bool> known = p->lookup<User>(session_, p->followings_,
+            { "me", "followings.json" }, "user", userid,
+            Outbox::Action::follow, Outbox::Action::unfollow);
+    if (known.valid()) {
+        return known;
+    }
+
     net::Uri::QueryParameters params;
 
-    return p->async_get<bool>(
+    return p->async_get<bool>(session_,
         { "me", "followings", userid}, params,
         [](const json::Value &root) {
             auto results = is_successful<bool>(root);
@@ -545,37 +2373,22 @@ std::future<bool> Client::is_user_follower(const string &userid) {
 }
 
 future<bool> Client::follow_user(const std::string &userid) {
-    net::Uri::QueryParameters params;
-
-    return p->async_put<bool>(
-        { "me", "followings", userid}, params, "",
-        [](const json::Value &root) {
-            auto results = is_successful<bool>(root);
-            return results;
-    });
+    return p->enqueue(session_, Outbox::Action::follow, userid);
 }
 
 std::future<bool> Client::unfollow_user(const string &userid)
 {
-    net::Uri::QueryParameters params;
-
-    return p->async_del<bool>(
-        { "me", "followings", userid}, params,
-        [](const json::Value &root) {
-            auto results = is_successful<bool>(root);
-            return results;
-    });
+    return p->enqueue(session_, Outbox::Action::unfollow, userid);
 }
 
 std::future<User> Client::get_authuser_info()
 {
     net::Uri::QueryParameters params;
 
-    return p->async_get<User>(
+    return p->async_decode<User>(session_,
         { "me" }, params,
-        [](const json::Value &root) {
-            auto results = get_typed_authuser_info<User>("user", root);
-            return results;
+        []() {
+            return make_shared<ObjectDecoder<User>>("user");
     });
 }
 
@@ -583,23 +2396,52 @@ std::future<User> Client::get_user_info(const string &userid)
 {
     net::Uri::QueryParameters params;
 
-    return p->async_get<User>(
+    return p->async_decode<User>(session_,
         { "users", userid}, params,
-        [](const json::Value &root) {
-            auto results = get_typed_authuser_info<User>("user", root);
-            return results;
+        []() {
+            return make_shared<ObjectDecoder<User>>("user");
     });
 }
 
 void Client::cancel() {
-    p->cancelled_ = true;
+    session_->cancel();
+}
+
+void Client::set_deadline(const chrono::steady_clock::time_point &deadline) {
+    session_->deadline = deadline.time_since_epoch().count();
+}
+
+void Client::set_waker(const Waker::Ptr &waker) {
+    lock_guard<mutex> lock(session_->requests_mutex);
+    session_->waker = waker;
+}
+
+chrono::steady_clock::time_point Client::deadline() const {
+    return chrono::steady_clock::time_point(
+            chrono::steady_clock::duration(session_->deadline));
 }
 
 std::string Client::client_id() {
-    return p->client_id();
+    return p->client_id(session_);
 }
 
 bool Client::authenticated() {
-    return p->authenticated();
+    return p->authenticated(session_);
+}
+
+string Client::owner() {
+    return p->owner(session_);
+}
+
+Client::Statistics Client::statistics() const {
+    Statistics statistics;
+    statistics.credential_lookups = session_->credential_lookups;
+    statistics.credential_lookups_saved = session_->credential_lookups_saved;
+    statistics.result_cache_hits = session_->result_cache_hits;
+    statistics.result_cache_misses = session_->result_cache_misses;
+    statistics.result_cache_bytes = p->result_cache_->statistics().bytes;
+    statistics.revalidated = session_->revalidated;
+    statistics.coalesced = session_->coalesced;
+    return statistics;
 }
 
@@ -30,12 +30,16 @@ Comment::Comment(const json::Value &data) :
         user_(data["user"]) {
     body_ = data["body"].asString();
     created_at_ = data["created_at"].asString();
-    
+
+    id_ = data["id"].asUInt();
+
+    normalize();
+}
+
+void Comment::normalize() {
     std::vector<std::string> created_time;
     boost::split(created_time, created_at_, boost::is_any_of(" "));
     created_at_ = created_time[0];
-
-    id_ = data["id"].asUInt();
 }
 
 const unsigned int & Comment::id() const {
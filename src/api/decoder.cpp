@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/decoder.h>
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace json = Json;
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+template<typename T>
+static typename Schema<T>::Field text(string T::*member) {
+    return { member, nullptr, nullptr, nullptr };
+}
+
+template<typename T>
+static typename Schema<T>::Field number(unsigned int T::*member) {
+    return { nullptr, member, nullptr, nullptr };
+}
+
+template<typename T>
+static typename Schema<T>::Field flag(bool T::*member) {
+    return { nullptr, nullptr, member, nullptr };
+}
+
+template<typename T>
+static typename Schema<T>::Field user(User T::*member) {
+    return { nullptr, nullptr, nullptr, member };
+}
+
+static unsigned int to_unsigned(const string &text) {
+    if (text.find_first_of(".eE") != string::npos) {
+        double value = strtod(text.c_str(), nullptr);
+        return value > 0 ? (unsigned int) value : 0;
+    }
+    if (text[0] == '-') {
+        return 0;
+    }
+    return strtoul(text.c_str(), nullptr, 10);
+}
+
+/**
+ * Store a scalar the way the Json::Value accessors would convert it.
+ * Conversions the accessors reject give the empty value instead.
+ */
+template<typename T>
+static void assign(T &object, const typename Schema<T>::Field &field,
+                   typename ResourceReader<T>::Scalar type, const string &text) {
+    typedef typename ResourceReader<T>::Scalar Scalar;
+
+    if (field.text) {
+        string &member = object.*field.text;
+        switch (type) {
+        case Scalar::string:
+        case Scalar::number:
+            member = text;
+            break;
+        case Scalar::boolean:
+            member = text == "1" ? "true" : "false";
+            break;
+        case Scalar::null:
+            member.clear();
+            break;
+        }
+    } else if (field.number) {
+        unsigned int &member = object.*field.number;
+        switch (type) {
+        case Scalar::number:
+            member = to_unsigned(text);
+            break;
+        case Scalar::boolean:
+            member = text == "1" ? 1 : 0;
+            break;
+        default:
+            member = 0;
+        }
+    } else if (field.flag) {
+        bool &member = object.*field.flag;
+        switch (type) {
+        case Scalar::number:
+            member = strtod(text.c_str(), nullptr) != 0;
+            break;
+        case Scalar::boolean:
+            member = text == "1";
+            break;
+        default:
+            member = false;
+        }
+    }
+}
+
+static const string TRUE_TEXT = "1";
+
+static const string FALSE_TEXT = "0";
+
+static const string EMPTY_TEXT;
+
+}
+
+namespace api {
+
+template<>
+const unordered_map<string, Schema<Track>::Field> & Schema<Track>::fields() {
+    static const unordered_map<string, Field> fields {
+        { "id", number(&Track::id_) },
+        { "title", text(&Track::title_) },
+        { "description", text(&Track::description_) },
+        { "label_name", text(&Track::label_name_) },
+        { "duration", number(&Track::duration_) },
+        { "license", text(&Track::license_) },
+        { "created_at", text(&Track::created_at_) },
+        { "playback_count", number(&Track::playback_count_) },
+        { "favoritings_count", number(&Track::favoritings_count_) },
+        { "comment_count", number(&Track::comment_count_) },
+        { "reposts_count", number(&Track::repost_count_) },
+        { "likes_count", number(&Track::likes_count_) },
+        { "artwork_url", text(&Track::artwork_) },
+        { "waveform_url", text(&Track::waveform_) },
+        { "streamable", flag(&Track::streamable_) },
+        { "downloadable", flag(&Track::downloadable_) },
+        { "permalink_url", text(&Track::permalink_url_) },
+        { "purchase_url", text(&Track::purchase_url_) },
+        { "stream_url", text(&Track::stream_url_) },
+        { "download_url", text(&Track::download_url_) },
+        { "video_url", text(&Track::video_url_) },
+        { "genre", text(&Track::genre_) },
+        { "original_format", text(&Track::original_format_) },
+        { "user", user(&Track::user_) }
+    };
+    return fields;
+}
+
+template<>
+const Track & Schema<Track>::blank() {
+    static const Track blank((json::Value()));
+    return blank;
+}
+
+template<>
+void Schema<Track>::finish(Track &value) {
+    value.normalize();
+}
+
+template<>
+const unordered_map<string, Schema<User>::Field> & Schema<User>::fields() {
+    static const unordered_map<string, Field> fields {
+        { "username", text(&User::title_) },
+        { "id", number(&User::id_) },
+        { "avatar_url", text(&User::artwork_) },
+        { "permalink_url", text(&User::permalink_) },
+        { "track_count", number(&User::track_count_) },
+        { "followers_count", number(&User::followers_count_) },
+        { "followings_count", number(&User::followings_count_) },
+        { "description", text(&User::bio_) }
+    };
+    return fields;
+}
+
+template<>
+const User & Schema<User>::blank() {
+    static const User blank((json::Value()));
+    return blank;
+}
+
+template<>
+void Schema<User>::finish(User &) {
+}
+
+template<>
+const unordered_map<string, Schema<Comment>::Field> & Schema<Comment>::fields() {
+    static const unordered_map<string, Field> fields {
+        { "body", text(&Comment::body_) },
+        { "created_at", text(&Comment::created_at_) },
+        { "id", number(&Comment::id_) },
+        { "user", user(&Comment::user_) }
+    };
+    return fields;
+}
+
+template<>
+const Comment & Schema<Comment>::blank() {
+    static const Comment blank((json::Value()));
+    return blank;
+}
+
+template<>
+void Schema<Comment>::finish(Comment &value) {
+    value.normalize();
+}
+
+}
+
+template<typename T>
+void ResourceReader<T>::begin() {
+    value_ = Schema<T>::blank();
+    kind_.clear();
+    depth_ = 0;
+    field_ = nullptr;
+    kind_field_ = false;
+    user_ = nullptr;
+    user_field_ = nullptr;
+}
+
+template<typename T>
+void ResourceReader<T>::key(const string &name) {
+    if (depth_ == 0) {
+        const auto &fields = Schema<T>::fields();
+        auto it = fields.find(name);
+        field_ = (it == fields.end()) ? nullptr : &it->second;
+        kind_field_ = (name == "kind");
+    } else if (depth_ == 1 && user_) {
+        const auto &fields = Schema<User>::fields();
+        auto it = fields.find(name);
+        user_field_ = (it == fields.end()) ? nullptr : &it->second;
+    }
+}
+
+template<typename T>
+void ResourceReader<T>::scalar(Scalar type, const string &text) {
+    if (depth_ == 0) {
+        if (kind_field_ && type == Scalar::string) {
+            kind_ = text;
+        }
+        if (field_) {
+            assign<T>(value_, *field_, type, text);
+        }
+        field_ = nullptr;
+        kind_field_ = false;
+    } else if (depth_ == 1 && user_ && user_field_) {
+        assign<User>(*user_, *user_field_,
+                     typename ResourceReader<User>::Scalar(int(type)), text);
+        user_field_ = nullptr;
+    }
+}
+
+template<typename T>
+void ResourceReader<T>::start_container(bool object) {
+    if (depth_ == 0) {
+        if (object && field_ && field_->user) {
+            user_ = &(value_.*(field_->user));
+            user_field_ = nullptr;
+        }
+        field_ = nullptr;
+        kind_field_ = false;
+    }
+    ++depth_;
+}
+
+template<typename T>
+bool ResourceReader<T>::end_container() {
+    if (depth_ == 0) {
+        Schema<T>::finish(value_);
+        return true;
+    }
+    if (--depth_ == 0) {
+        user_ = nullptr;
+    }
+    return false;
+}
+
+template<typename T>
+T & ResourceReader<T>::value() {
+    return value_;
+}
+
+template<typename T>
+const string & ResourceReader<T>::kind() const {
+    return kind_;
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::start_object() {
+    if (reading_) {
+        reader_.start_container(true);
+    } else if (container(true)) {
+        reader_.begin();
+        reading_ = true;
+    } else {
+        ++depth_;
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::end_object() {
+    if (reading_) {
+        if (reader_.end_container()) {
+            reading_ = false;
+            resource(reader_.value(), reader_.kind());
+        }
+    } else {
+        --depth_;
+        container_end();
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::start_array() {
+    if (reading_) {
+        reader_.start_container(false);
+    } else {
+        container(false);
+        ++depth_;
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::end_array() {
+    if (reading_) {
+        reader_.end_container();
+    } else {
+        --depth_;
+        container_end();
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::key(const string &name) {
+    if (reading_) {
+        reader_.key(name);
+    } else {
+        outer_key(name);
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::string_value(const string &value) {
+    if (reading_) {
+        reader_.scalar(Scalar::string, value);
+    } else {
+        outer_scalar(Scalar::string, value);
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::number_value(const string &text) {
+    if (reading_) {
+        reader_.scalar(Scalar::number, text);
+    } else {
+        outer_scalar(Scalar::number, text);
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::bool_value(bool value) {
+    const string &text = value ? TRUE_TEXT : FALSE_TEXT;
+    if (reading_) {
+        reader_.scalar(Scalar::boolean, text);
+    } else {
+        outer_scalar(Scalar::boolean, text);
+    }
+}
+
+template<typename T, typename R>
+void ResourceDecoder<T, R>::null_value() {
+    if (reading_) {
+        reader_.scalar(Scalar::null, EMPTY_TEXT);
+    } else {
+        outer_scalar(Scalar::null, EMPTY_TEXT);
+    }
+}
+
+template<typename T>
+ListDecoder<T>::ListDecoder(const string &kind, const Order &order,
+                            const typename Channel<T>::Ptr &channel) :
+        kind_(kind), order_(order), channel_(channel) {
+}
+
+template<typename T>
+bool ListDecoder<T>::container(bool object) {
+    // root [ { ... } ] or { "collection": [ { ... } ] }
+    if (this->depth_ == 0 && !object) {
+        root_array_ = true;
+    } else if (this->depth_ == 1 && !object && !root_array_
+            && key_ == "collection") {
+        in_collection_ = true;
+    }
+    return object && ((root_array_ && this->depth_ == 1)
+            || (in_collection_ && this->depth_ == 2));
+}
+
+template<typename T>
+void ListDecoder<T>::container_end() {
+    if (this->depth_ == 1) {
+        in_collection_ = false;
+    }
+}
+
+template<typename T>
+void ListDecoder<T>::outer_key(const string &name) {
+    if (this->depth_ == 1) {
+        key_ = name;
+    }
+}
+
+template<typename T>
+void ListDecoder<T>::resource(T &value, const string &kind) {
+    if (kind == kind_) {
+        results_.emplace_back(move(value));
+        // Sorted lists are only final at the end
+        if (channel_ && !order_) {
+            channel_->offer(results_.size() - 1, results_.back());
+        }
+    }
+}
+
+template<typename T>
+deque<T> ListDecoder<T>::result() {
+    if (order_) {
+        stable_sort(results_.begin(), results_.end(), order_);
+    }
+    if (channel_) {
+        if (order_) {
+            for (size_t i = 0; i < results_.size(); ++i) {
+                channel_->offer(i, results_[i]);
+            }
+        }
+        channel_->close();
+    }
+    return move(results_);
+}
+
+template<typename T>
+ActivityListDecoder<T>::ActivityListDecoder(const string &type,
+                                            const typename Channel<T>::Ptr &channel) :
+        type_(type), channel_(channel) {
+}
+
+template<typename T>
+bool ActivityListDecoder<T>::container(bool object) {
+    // root { "collection": [ { "type": ..., "origin": { ... } } ] }
+    if (!object && this->depth_ == 1 && key_ == "collection") {
+        in_collection_ = true;
+    } else if (object && this->depth_ == 2 && in_collection_) {
+        activity_type_.clear();
+        has_origin_ = false;
+    } else if (object && this->depth_ == 3 && in_collection_
+            && key_ == "origin") {
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+void ActivityListDecoder<T>::container_end() {
+    if (this->depth_ == 2 && in_collection_) {
+        if (has_origin_ && activity_type_ == type_) {
+            results_.emplace_back(move(origin_));
+            if (channel_) {
+                channel_->offer(results_.size() - 1, results_.back());
+            }
+        }
+    } else if (this->depth_ == 1) {
+        in_collection_ = false;
+    }
+}
+
+template<typename T>
+void ActivityListDecoder<T>::outer_key(const string &name) {
+    key_ = name;
+}
+
+template<typename T>
+void ActivityListDecoder<T>::outer_scalar(Scalar type, const string &text) {
+    if (this->depth_ == 3 && in_collection_ && key_ == "type"
+            && type == Scalar::string) {
+        activity_type_ = text;
+    }
+}
+
+template<typename T>
+void ActivityListDecoder<T>::resource(T &value, const string &) {
+    origin_ = move(value);
+    has_origin_ = true;
+}
+
+template<typename T>
+deque<T> ActivityListDecoder<T>::result() {
+    if (channel_) {
+        channel_->close();
+    }
+    return move(results_);
+}
+
+template<typename T>
+PageDecoder<T>::PageDecoder(const typename Decoder<deque<T>>::Ptr &items) :
+        items_(items) {
+}
+
+template<typename T>
+void PageDecoder<T>::start_object() {
+    ++depth_;
+    items_->start_object();
+}
+
+template<typename T>
+void PageDecoder<T>::end_object() {
+    --depth_;
+    items_->end_object();
+}
+
+template<typename T>
+void PageDecoder<T>::start_array() {
+    ++depth_;
+    items_->start_array();
+}
+
+template<typename T>
+void PageDecoder<T>::end_array() {
+    --depth_;
+    items_->end_array();
+}
+
+template<typename T>
+void PageDecoder<T>::key(const string &name) {
+    if (depth_ == 1) {
+        key_ = name;
+    }
+    items_->key(name);
+}
+
+template<typename T>
+void PageDecoder<T>::string_value(const string &value) {
+    if (depth_ == 1 && key_ == "next_href") {
+        page_.next_href = value;
+    } else if (depth_ == 1 && key_ == "future_href") {
+        page_.future_href = value;
+    }
+    items_->string_value(value);
+}
+
+template<typename T>
+void PageDecoder<T>::number_value(const string &text) {
+    items_->number_value(text);
+}
+
+template<typename T>
+void PageDecoder<T>::bool_value(bool value) {
+    items_->bool_value(value);
+}
+
+template<typename T>
+void PageDecoder<T>::null_value() {
+    items_->null_value();
+}
+
+template<typename T>
+Page<T> PageDecoder<T>::result() {
+    page_.items = items_->result();
+    return move(page_);
+}
+
+template<typename T>
+ObjectDecoder<T>::ObjectDecoder(const string &kind) :
+        kind_(kind) {
+}
+
+template<typename T>
+bool ObjectDecoder<T>::container(bool object) {
+    return object && this->depth_ == 0;
+}
+
+template<typename T>
+void ObjectDecoder<T>::resource(T &value, const string &kind) {
+    if (kind == kind_) {
+        value_ = move(value);
+    }
+}
+
+template<typename T>
+T ObjectDecoder<T>::result() {
+    return move(value_);
+}
+
+namespace api {
+
+template class ResourceReader<Track>;
+template class ResourceReader<User>;
+template class ResourceReader<Comment>;
+
+template class ResourceDecoder<Track, deque<Track>>;
+template class ResourceDecoder<User, deque<User>>;
+template class ResourceDecoder<Comment, deque<Comment>>;
+template class ResourceDecoder<User, User>;
+
+template class ListDecoder<Track>;
+template class ListDecoder<User>;
+template class ListDecoder<Comment>;
+
+template class ActivityListDecoder<Track>;
+
+template class PageDecoder<Track>;
+
+template class ObjectDecoder<User>;
+
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/disk_cache.h>
+
+#include <boost/crc.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utime.h>
+#include <vector>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+static const string MAGIC = "soundcloud-cache 2";
+
+static uint32_t checksum(const string &data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+static bool is_entry_name(const string &name) {
+    if (name.size() != 16) {
+        return false;
+    }
+    return name.find_first_not_of("0123456789abcdef") == string::npos;
+}
+
+static long long to_seconds(const DiskCache::Clock::time_point &t) {
+    return chrono::duration_cast<chrono::seconds>(t.time_since_epoch()).count();
+}
+
+static DiskCache::Clock::time_point from_seconds(long long s) {
+    return DiskCache::Clock::time_point(chrono::seconds(s));
+}
+
+}
+
+bool DiskCache::Entry::fresh() const {
+    return Clock::now() < expiry;
+}
+
+DiskCache::DiskCache(const string &directory, size_t max_size) :
+        directory_(directory), max_size_(max_size) {
+    if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+        cerr << "Could not create cache directory " << directory_ << endl;
+    }
+    load_index();
+}
+
+string DiskCache::digest(const string &data) {
+    // FNV-1a, which unlike std::hash is stable between builds
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+    return buffer;
+}
+
+string DiskCache::path(const string &name) const {
+    return directory_ + "/" + name;
+}
+
+void DiskCache::load_index() {
+    lock_guard<mutex> lock(mutex_);
+
+    DIR *dir = opendir(directory_.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent *ent = readdir(dir)) {
+        string name = ent->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        struct stat st;
+        if (stat(path(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (!is_entry_name(name)) {
+            // Left behind by an interrupted write
+            ::remove(path(name).c_str());
+            continue;
+        }
+        index_[name] = Index { size_t(st.st_size), Clock::from_time_t(st.st_mtime) };
+        size_ += st.st_size;
+    }
+    closedir(dir);
+
+    evict(0);
+}
+
+bool DiskCache::get(const string &key, Entry &entry) {
+    lock_guard<mutex> lock(mutex_);
+
+    string name = digest(key);
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+        return false;
+    }
+
+    ifstream in(path(name), ios::binary);
+    string magic, stored_key, etag, last_modified, header;
+    getline(in, magic);
+    getline(in, stored_key);
+    getline(in, etag);
+    getline(in, last_modified);
+    getline(in, header);
+
+    long long stored = 0, expiry = 0;
+    size_t size = 0;
+    uint32_t crc = 0;
+    istringstream fields(header);
+    fields >> stored >> expiry >> size >> crc;
+
+    string body;
+    if (in && fields && magic == MAGIC && stored_key == key) {
+        body.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    if (body.size() != size || checksum(body) != crc || size == 0) {
+        erase(name);
+        return false;
+    }
+
+    entry.body = move(body);
+    entry.etag = etag;
+    entry.last_modified = last_modified;
+    entry.stored = from_seconds(stored);
+    entry.expiry = from_seconds(expiry);
+
+    // Remember the access, across restarts too
+    it->second.last_used = Clock::now();
+    utime(path(name).c_str(), nullptr);
+
+    return true;
+}
+
+void DiskCache::put(const string &key, const Entry &entry) {
+    lock_guard<mutex> lock(mutex_);
+
+    string name = digest(key);
+    string final_path = path(name);
+    string temp_path = final_path + ".tmp";
+
+    {
+        ofstream out(temp_path, ios::binary | ios::trunc);
+        out << MAGIC << '\n' << key << '\n' << entry.etag << '\n'
+                << entry.last_modified << '\n' << to_seconds(entry.stored) << ' '
+                << to_seconds(entry.expiry) << ' ' << entry.body.size() << ' '
+                << checksum(entry.body) << '\n';
+        out.write(entry.body.data(), entry.body.size());
+        if (!out) {
+            ::remove(temp_path.c_str());
+            return;
+        }
+    }
+
+    // Make room first, so that we never go over the limit
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+        size_ -= it->second.size;
+        index_.erase(it);
+    }
+    struct stat st;
+    size_t size = (stat(temp_path.c_str(), &st) == 0) ? st.st_size : entry.body.size();
+    evict(size);
+
+    if (rename(temp_path.c_str(), final_path.c_str()) != 0) {
+        ::remove(temp_path.c_str());
+        return;
+    }
+    index_[name] = Index { size, Clock::now() };
+    size_ += size;
+}
+
+void DiskCache::remove(const string &key) {
+    lock_guard<mutex> lock(mutex_);
+    erase(digest(key));
+}
+
+void DiskCache::remove_prefix(const string &prefix) {
+    lock_guard<mutex> lock(mutex_);
+
+    vector<string> names;
+    for (const auto &entry : index_) {
+        ifstream in(path(entry.first), ios::binary);
+        string magic, key;
+        getline(in, magic);
+        getline(in, key);
+        if (in && key.compare(0, prefix.size(), prefix) == 0) {
+            names.emplace_back(entry.first);
+        }
+    }
+    for (const auto &name : names) {
+        erase(name);
+    }
+}
+
+size_t DiskCache::size() const {
+    lock_guard<mutex> lock(mutex_);
+    return size_;
+}
+
+void DiskCache::erase(const string &name) {
+    ::remove(path(name).c_str());
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+        size_ -= it->second.size;
+        index_.erase(it);
+    }
+}
+
+void DiskCache::evict(size_t needed) {
+    while (!index_.empty() && size_ + needed > max_size_) {
+        auto oldest = index_.begin();
+        for (auto it = index_.begin(); it != index_.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) {
+                oldest = it;
+            }
+        }
+        erase(oldest->first);
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/hotness.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <queue>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * Weights of the engagement signals, relative to a play
+ */
+static const double LIKE_WEIGHT = 10.0;
+
+static const double REPOST_WEIGHT = 20.0;
+
+static const double COMMENT_WEIGHT = 5.0;
+
+static const double HALF_LIFE_DAYS = 7.0;
+
+/**
+ * Days between the track's creation date (YYYY/MM/DD) and @a now, or 0 if
+ * the date cannot be read
+ */
+static double age_days(const Track &track,
+                       const chrono::system_clock::time_point &now) {
+    struct tm created = tm();
+    if (sscanf(track.created_at().c_str(), "%d/%d/%d", &created.tm_year,
+               &created.tm_mon, &created.tm_mday) != 3) {
+        return 0.0;
+    }
+    created.tm_year -= 1900;
+    created.tm_mon -= 1;
+    time_t created_time = timegm(&created);
+    if (created_time == time_t(-1)) {
+        return 0.0;
+    }
+    double seconds = difftime(chrono::system_clock::to_time_t(now),
+                              created_time);
+    return max(0.0, seconds / (24 * 60 * 60));
+}
+
+}
+
+double api::hotness(const Track &track,
+                    const chrono::system_clock::time_point &now) {
+    // Favorite lists carry likes_count, other lists favoritings_count
+    double likes = max(track.likes_count(), track.favoritings_count());
+    double engagement = track.playback_count() + LIKE_WEIGHT * likes
+            + REPOST_WEIGHT * track.repost_count()
+            + COMMENT_WEIGHT * track.comment_count();
+    return log1p(engagement) - log(2.0) * age_days(track, now) / HALF_LIFE_DAYS;
+}
+
+deque<Track> api::hottest(const deque<Track> &tracks, size_t k,
+                          const chrono::system_clock::time_point &now) {
+    vector<pair<double, size_t>> scores;
+    scores.reserve(tracks.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        scores.emplace_back(hotness(tracks[i], now), i);
+    }
+
+    // Only the top k have to be put in order
+    k = min(k, scores.size());
+    partial_sort(scores.begin(), scores.begin() + k, scores.end(),
+                 [](const pair<double, size_t> &a, const pair<double, size_t> &b) {
+                     return a.first > b.first
+                             || (a.first == b.first && a.second < b.second);
+                 });
+
+    deque<Track> result;
+    for (size_t i = 0; i < k; ++i) {
+        result.emplace_back(tracks[scores[i].second]);
+    }
+    return result;
+}
+
+deque<Track> api::merge_hottest(const vector<deque<Track>> &lists, size_t k,
+                                const chrono::system_clock::time_point &now) {
+    // Score, list and position of the next track of each list. Ties go
+    // to the list that comes first.
+    typedef tuple<double, size_t, size_t> Head;
+    auto cooler = [](const Head &a, const Head &b) {
+        return get<0>(a) < get<0>(b)
+                || (get<0>(a) == get<0>(b) && get<1>(a) > get<1>(b));
+    };
+    priority_queue<Head, vector<Head>, decltype(cooler)> heads(cooler);
+    for (size_t i = 0; i < lists.size(); ++i) {
+        if (!lists[i].empty()) {
+            heads.emplace(hotness(lists[i].front(), now), i, 0);
+        }
+    }
+
+    deque<Track> result;
+    set<unsigned int> seen;
+    while (result.size() < k && !heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        const deque<Track> &list = lists[get<1>(head)];
+        const Track &track = list[get<2>(head)];
+        if (seen.insert(track.id()).second) {
+            result.emplace_back(track);
+        }
+        size_t next = get<2>(head) + 1;
+        if (next < list.size()) {
+            heads.emplace(hotness(list[next], now), get<1>(head), next);
+        }
+    }
+    return result;
+}
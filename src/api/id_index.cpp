@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/id_index.h>
+
+#include <algorithm>
+
+using namespace api;
+using namespace std;
+
+IdIndex::IdIndex(Clock::duration max_age, Clock::duration retry) :
+        max_age_(max_age), retry_(retry) {
+}
+
+IdIndex::Answer IdIndex::lookup(const string &owner, unsigned int id) const {
+    lock_guard<mutex> lock(mutex_);
+    if (!known_ || owner != owner_) {
+        return Answer::unknown;
+    }
+    if (binary_search(ids_.begin(), ids_.end(), id)) {
+        return Answer::yes;
+    }
+    return complete_ ? Answer::no : Answer::unknown;
+}
+
+bool IdIndex::start_sync(const string &owner) {
+    lock_guard<mutex> lock(mutex_);
+    if (owner != owner_) {
+        // Someone else logged in
+        owner_ = owner;
+        ids_.clear();
+        edits_.clear();
+        known_ = false;
+        complete_ = false;
+        syncing_ = false;
+        next_sync_ = Clock::time_point();
+    }
+    if (syncing_ || Clock::now() < next_sync_) {
+        return false;
+    }
+    syncing_ = true;
+    return true;
+}
+
+void IdIndex::synced(const string &owner, vector<unsigned int> ids,
+                     bool complete) {
+    lock_guard<mutex> lock(mutex_);
+    if (owner != owner_) {
+        return;
+    }
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    ids_ = move(ids);
+    for (const auto &edit : edits_) {
+        apply(edit.first, edit.second);
+    }
+    edits_.clear();
+    known_ = true;
+    complete_ = complete;
+    syncing_ = false;
+    next_sync_ = Clock::now() + max_age_;
+}
+
+void IdIndex::sync_failed(const string &owner) {
+    lock_guard<mutex> lock(mutex_);
+    if (owner != owner_) {
+        return;
+    }
+    syncing_ = false;
+    next_sync_ = Clock::now() + retry_;
+}
+
+void IdIndex::add(const string &owner, unsigned int id) {
+    edit(owner, id, true);
+}
+
+void IdIndex::remove(const string &owner, unsigned int id) {
+    edit(owner, id, false);
+}
+
+size_t IdIndex::size() const {
+    lock_guard<mutex> lock(mutex_);
+    return ids_.size();
+}
+
+void IdIndex::edit(const string &owner, unsigned int id, bool present) {
+    lock_guard<mutex> lock(mutex_);
+    if (owner != owner_) {
+        return;
+    }
+    apply(id, present);
+    edits_.emplace_back(id, present);
+}
+
+void IdIndex::apply(unsigned int id, bool present) {
+    auto it = lower_bound(ids_.begin(), ids_.end(), id);
+    bool found = it != ids_.end() && *it == id;
+    if (present && !found) {
+        ids_.insert(it, id);
+    } else if (!present && found) {
+        ids_.erase(it);
+    }
+}
@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/json_stream.h>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace io = boost::iostreams;
+namespace json = Json;
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.'
+            || c == 'e' || c == 'E';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+}
+
+JsonStreamParser::JsonStreamParser(Handler &handler) :
+        handler_(handler) {
+}
+
+void JsonStreamParser::error(const string &what) const {
+    throw domain_error(
+            "Malformed JSON at offset " + to_string(offset_) + ": " + what);
+}
+
+void JsonStreamParser::feed(const char *data, size_t size) {
+    const char *end = data + size;
+    for (const char *it = data; it != end; ++it, ++offset_) {
+        char c = *it;
+
+        switch (lexeme_) {
+        case Lexeme::string: {
+            // Copy runs of plain characters in one go
+            const char *run = it;
+            while (run != end && *run != '"' && *run != '\\'
+                    && (unsigned char) *run >= 0x20) {
+                ++run;
+            }
+            if (run != it) {
+                if (high_surrogate_) {
+                    append_utf8(0xFFFD);
+                    high_surrogate_ = 0;
+                }
+                token_.append(it, run);
+                offset_ += run - it;
+                it = run;
+                if (it == end) {
+                    return;
+                }
+                c = *it;
+            }
+            if (c == '"') {
+                end_string();
+            } else if (c == '\\') {
+                lexeme_ = Lexeme::escape;
+            } else {
+                error("control character in string");
+            }
+            continue;
+        }
+
+        case Lexeme::escape:
+            lexeme_ = Lexeme::string;
+            if (c == 'u') {
+                lexeme_ = Lexeme::unicode;
+                unicode_digits_ = 0;
+                code_unit_ = 0;
+                continue;
+            }
+            if (high_surrogate_) {
+                append_utf8(0xFFFD);
+                high_surrogate_ = 0;
+            }
+            switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                token_ += c;
+                break;
+            case 'b':
+                token_ += '\b';
+                break;
+            case 'f':
+                token_ += '\f';
+                break;
+            case 'n':
+                token_ += '\n';
+                break;
+            case 'r':
+                token_ += '\r';
+                break;
+            case 't':
+                token_ += '\t';
+                break;
+            default:
+                error("bad escape sequence");
+            }
+            continue;
+
+        case Lexeme::unicode: {
+            int digit = hex_value(c);
+            if (digit < 0) {
+                error("bad unicode escape");
+            }
+            code_unit_ = (code_unit_ << 4) | digit;
+            if (++unicode_digits_ == 4) {
+                lexeme_ = Lexeme::string;
+                append_code_unit(code_unit_);
+            }
+            continue;
+        }
+
+        case Lexeme::number:
+            if (is_number_char(c)) {
+                token_ += c;
+                continue;
+            }
+            end_number();
+            break;
+
+        case Lexeme::literal:
+            if (c >= 'a' && c <= 'z') {
+                token_ += c;
+                continue;
+            }
+            end_literal();
+            break;
+
+        case Lexeme::none:
+            break;
+        }
+
+        // Between tokens
+        if (is_space(c)) {
+            continue;
+        }
+        if (c == '"') {
+            if (expect_ != Expect::key && expect_ != Expect::key_or_end) {
+                begin_value();
+            }
+            lexeme_ = Lexeme::string;
+            token_.clear();
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            begin_value();
+            lexeme_ = Lexeme::number;
+            token_.assign(1, c);
+        } else if (c >= 'a' && c <= 'z') {
+            begin_value();
+            lexeme_ = Lexeme::literal;
+            token_.assign(1, c);
+        } else {
+            punctuation(c);
+        }
+    }
+}
+
+void JsonStreamParser::finish() {
+    switch (lexeme_) {
+    case Lexeme::number:
+        end_number();
+        break;
+    case Lexeme::literal:
+        end_literal();
+        break;
+    case Lexeme::none:
+        break;
+    default:
+        error("unterminated string");
+    }
+    if (expect_ != Expect::done) {
+        error("unexpected end of document");
+    }
+}
+
+void JsonStreamParser::begin_value() {
+    if (expect_ != Expect::value && expect_ != Expect::value_or_end) {
+        error("unexpected value");
+    }
+}
+
+void JsonStreamParser::end_value() {
+    if (containers_.empty()) {
+        expect_ = Expect::done;
+    } else {
+        expect_ = Expect::comma_or_end;
+    }
+}
+
+void JsonStreamParser::punctuation(char c) {
+    switch (c) {
+    case '{':
+        begin_value();
+        containers_.push_back('{');
+        expect_ = Expect::key_or_end;
+        handler_.start_object();
+        return;
+
+    case '[':
+        begin_value();
+        containers_.push_back('[');
+        expect_ = Expect::value_or_end;
+        handler_.start_array();
+        return;
+
+    case '}':
+        if (containers_.empty() || containers_.back() != '{'
+                || (expect_ != Expect::key_or_end
+                        && expect_ != Expect::comma_or_end)) {
+            error("unexpected '}'");
+        }
+        containers_.pop_back();
+        handler_.end_object();
+        end_value();
+        return;
+
+    case ']':
+        if (containers_.empty() || containers_.back() != '['
+                || (expect_ != Expect::value_or_end
+                        && expect_ != Expect::comma_or_end)) {
+            error("unexpected ']'");
+        }
+        containers_.pop_back();
+        handler_.end_array();
+        end_value();
+        return;
+
+    case ':':
+        if (expect_ != Expect::colon) {
+            error("unexpected ':'");
+        }
+        expect_ = Expect::value;
+        return;
+
+    case ',':
+        if (expect_ != Expect::comma_or_end) {
+            error("unexpected ','");
+        }
+        expect_ = containers_.back() == '{' ? Expect::key : Expect::value;
+        return;
+    }
+
+    error(string("unexpected character '") + c + "'");
+}
+
+void JsonStreamParser::end_string() {
+    lexeme_ = Lexeme::none;
+    if (high_surrogate_) {
+        append_utf8(0xFFFD);
+        high_surrogate_ = 0;
+    }
+    if (expect_ == Expect::key || expect_ == Expect::key_or_end) {
+        handler_.key(token_);
+        expect_ = Expect::colon;
+    } else {
+        handler_.string_value(token_);
+        end_value();
+    }
+}
+
+void JsonStreamParser::end_number() {
+    lexeme_ = Lexeme::none;
+    char *end = nullptr;
+    strtod(token_.c_str(), &end);
+    if (end != token_.c_str() + token_.size()) {
+        error("bad number");
+    }
+    handler_.number_value(token_);
+    end_value();
+}
+
+void JsonStreamParser::end_literal() {
+    lexeme_ = Lexeme::none;
+    if (token_ == "true") {
+        handler_.bool_value(true);
+    } else if (token_ == "false") {
+        handler_.bool_value(false);
+    } else if (token_ == "null") {
+        handler_.null_value();
+    } else {
+        error("unknown literal");
+    }
+    end_value();
+}
+
+void JsonStreamParser::append_code_unit(uint32_t unit) {
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        if (high_surrogate_) {
+            append_utf8(0xFFFD);
+        }
+        high_surrogate_ = unit;
+        return;
+    }
+    if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        if (high_surrogate_) {
+            append_utf8(0x10000 + ((high_surrogate_ - 0xD800) << 10)
+                    + (unit - 0xDC00));
+            high_surrogate_ = 0;
+        } else {
+            append_utf8(0xFFFD);
+        }
+        return;
+    }
+    if (high_surrogate_) {
+        append_utf8(0xFFFD);
+        high_surrogate_ = 0;
+    }
+    append_utf8(unit);
+}
+
+void JsonStreamParser::append_utf8(uint32_t code_point) {
+    if (code_point < 0x80) {
+        token_ += char(code_point);
+    } else if (code_point < 0x800) {
+        token_ += char(0xC0 | (code_point >> 6));
+        token_ += char(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        token_ += char(0xE0 | (code_point >> 12));
+        token_ += char(0x80 | ((code_point >> 6) & 0x3F));
+        token_ += char(0x80 | (code_point & 0x3F));
+    } else {
+        token_ += char(0xF0 | (code_point >> 18));
+        token_ += char(0x80 | ((code_point >> 12) & 0x3F));
+        token_ += char(0x80 | ((code_point >> 6) & 0x3F));
+        token_ += char(0x80 | (code_point & 0x3F));
+    }
+}
+
+json::Value & JsonValueBuilder::add(json::ValueType type) {
+    if (stack_.empty()) {
+        root_ = json::Value(type);
+        return root_;
+    }
+    json::Value &parent = *stack_.back();
+    if (parent.isArray()) {
+        return parent.append(json::Value(type));
+    }
+    json::Value &child = parent[key_];
+    child = json::Value(type);
+    return child;
+}
+
+void JsonValueBuilder::start_object() {
+    stack_.emplace_back(&add(json::objectValue));
+}
+
+void JsonValueBuilder::end_object() {
+    stack_.pop_back();
+}
+
+void JsonValueBuilder::start_array() {
+    stack_.emplace_back(&add(json::arrayValue));
+}
+
+void JsonValueBuilder::end_array() {
+    stack_.pop_back();
+}
+
+void JsonValueBuilder::key(const string &name) {
+    key_ = name;
+}
+
+void JsonValueBuilder::string_value(const string &value) {
+    add(json::stringValue) = value;
+}
+
+void JsonValueBuilder::number_value(const string &text) {
+    // Pick the same representation as Json::Reader
+    json::Value &value = add(json::nullValue);
+    errno = 0;
+    if (text.find_first_of(".eE") != string::npos) {
+        value = strtod(text.c_str(), nullptr);
+    } else if (text[0] == '-') {
+        long long number = strtoll(text.c_str(), nullptr, 10);
+        value = errno ? json::Value(strtod(text.c_str(), nullptr)) :
+                json::Value(json::Value::Int64(number));
+    } else {
+        unsigned long long number = strtoull(text.c_str(), nullptr, 10);
+        if (errno) {
+            value = strtod(text.c_str(), nullptr);
+        } else if (number <= (unsigned long long) json::Value::maxInt64) {
+            value = json::Value::Int64(number);
+        } else {
+            value = json::Value::UInt64(number);
+        }
+    }
+}
+
+void JsonValueBuilder::bool_value(bool value) {
+    add(json::booleanValue) = value;
+}
+
+void JsonValueBuilder::null_value() {
+    add(json::nullValue);
+}
+
+json::Value & JsonValueBuilder::root() {
+    return root_;
+}
+
+namespace {
+
+/**
+ * The end of the inflate chain, handing inflated text to the parser
+ */
+class ParserSink {
+public:
+    typedef char char_type;
+    typedef io::sink_tag category;
+
+    ParserSink(JsonStreamParser &parser, bool &malformed) :
+            parser_(parser), malformed_(malformed) {
+    }
+
+    streamsize write(const char *data, streamsize size) {
+        if (!malformed_) {
+            try {
+                parser_.feed(data, size);
+            } catch (domain_error &) {
+                malformed_ = true;
+            }
+        }
+        return size;
+    }
+
+protected:
+    JsonStreamParser &parser_;
+
+    bool &malformed_;
+};
+
+}
+
+struct GzipJsonStream::Priv {
+    Priv(JsonStreamParser::Handler &handler) :
+            parser_(handler) {
+        os_.push(io::gzip_decompressor());
+        os_.push(ParserSink(parser_, malformed_));
+        os_.exceptions(ios_base::badbit);
+    }
+
+    JsonStreamParser parser_;
+
+    io::filtering_ostream os_;
+
+    bool malformed_ = false;
+
+    bool written_ = false;
+};
+
+GzipJsonStream::GzipJsonStream(JsonStreamParser::Handler &handler) :
+        p(new Priv(handler)) {
+}
+
+GzipJsonStream::~GzipJsonStream() {
+    try {
+        p->os_.reset();
+    } catch (...) {
+    }
+}
+
+void GzipJsonStream::write(const char *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    p->written_ = true;
+    try {
+        p->os_.write(data, size);
+        // Parse what we have so far, rather than waiting for the buffer to fill
+        p->os_.flush();
+    } catch (io::gzip_error &) {
+        throw;
+    } catch (ios_base::failure &) {
+        // The stream swallows what the inflater threw while flushing
+        throw io::gzip_error(io::zlib::data_error);
+    }
+}
+
+void GzipJsonStream::close() {
+    if (p->written_) {
+        try {
+            io::close(p->os_);
+        } catch (io::gzip_error &) {
+            throw;
+        } catch (ios_base::failure &) {
+            throw io::gzip_error(io::zlib::data_error);
+        }
+    }
+    if (!p->malformed_) {
+        try {
+            p->parser_.finish();
+        } catch (domain_error &) {
+            p->malformed_ = true;
+        }
+    }
+}
+
+bool GzipJsonStream::malformed() const {
+    return p->malformed_;
+}
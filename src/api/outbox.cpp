@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/outbox.h>
+
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+static const string MAGIC = "soundcloud-outbox 1";
+
+static const char * const ACTIONS[] = {
+    "like", "unlike", "follow", "unfollow", "comment"
+};
+
+static uint32_t checksum(const string &data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+static bool is_entry_name(const string &name) {
+    if (name.size() != 20) {
+        return false;
+    }
+    return name.find_first_not_of("0123456789") == string::npos;
+}
+
+static bool parse_action(const string &name, Outbox::Action &action) {
+    for (size_t i = 0; i < sizeof(ACTIONS) / sizeof(ACTIONS[0]); ++i) {
+        if (name == ACTIONS[i]) {
+            action = Outbox::Action(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+Outbox::Outbox(const string &directory) :
+        directory_(directory) {
+    if (directory_.empty()) {
+        return;
+    }
+    if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+        cerr << "Could not create outbox directory " << directory_ << endl;
+    }
+    load();
+}
+
+string Outbox::path(uint64_t sequence) const {
+    char name[21];
+    snprintf(name, sizeof(name), "%020llu", (unsigned long long) sequence);
+    return directory_ + "/" + name;
+}
+
+void Outbox::load() {
+    lock_guard<mutex> lock(mutex_);
+
+    DIR *dir = opendir(directory_.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent *ent = readdir(dir)) {
+        string name = ent->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        string file = directory_ + "/" + name;
+        if (!is_entry_name(name)) {
+            // Left behind by an interrupted write
+            ::remove(file.c_str());
+            continue;
+        }
+
+        ifstream in(file, ios::binary);
+        string magic, action, header;
+        Entry entry;
+        getline(in, magic);
+        getline(in, action);
+        getline(in, entry.target);
+        getline(in, entry.owner);
+        getline(in, header);
+
+        size_t size = 0;
+        uint32_t crc = 0;
+        istringstream fields(header);
+        fields >> entry.attempts >> size >> crc;
+
+        if (in && fields && magic == MAGIC
+                && parse_action(action, entry.action)) {
+            entry.body.assign(istreambuf_iterator<char>(in),
+                              istreambuf_iterator<char>());
+        }
+        if (!fields || entry.body.size() != size
+                || checksum(entry.body) != crc || entry.owner.empty()) {
+            cerr << "Dropping corrupt outbox entry " << name << endl;
+            ::remove(file.c_str());
+            continue;
+        }
+        entry.sequence = stoull(name);
+        entries_.emplace_back(entry);
+    }
+    closedir(dir);
+
+    sort(entries_.begin(), entries_.end(), [](const Entry &a, const Entry &b) {
+        return a.sequence < b.sequence;
+    });
+    if (!entries_.empty()) {
+        next_sequence_ = entries_.back().sequence + 1;
+    }
+}
+
+bool Outbox::write(const Entry &entry) {
+    if (directory_.empty()) {
+        return true;
+    }
+
+    string final_path = path(entry.sequence);
+    string temp_path = final_path + ".tmp";
+    {
+        ofstream out(temp_path, ios::binary | ios::trunc);
+        out << MAGIC << '\n' << ACTIONS[int(entry.action)] << '\n'
+                << entry.target << '\n' << entry.owner << '\n'
+                << entry.attempts << ' ' << entry.body.size() << ' '
+                << checksum(entry.body) << '\n';
+        out.write(entry.body.data(), entry.body.size());
+        if (!out) {
+            ::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    if (rename(temp_path.c_str(), final_path.c_str()) != 0) {
+        ::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+Outbox::Entry Outbox::push(Entry entry) {
+    lock_guard<mutex> lock(mutex_);
+
+    entry.sequence = next_sequence_++;
+    entry.attempts = 0;
+    entry.next_attempt = Clock::time_point();
+    if (!write(entry)) {
+        cerr << "Could not store outbox entry " << entry.sequence
+             << ", it will be lost on restart" << endl;
+    }
+    entries_.emplace_back(entry);
+    return entry;
+}
+
+bool Outbox::next(Entry &entry, Clock::time_point &due) const {
+    lock_guard<mutex> lock(mutex_);
+
+    if (entries_.empty()) {
+        due = Clock::time_point::max();
+        return false;
+    }
+    due = entries_.front().next_attempt;
+    if (Clock::now() < due) {
+        return false;
+    }
+    entry = entries_.front();
+    return true;
+}
+
+void Outbox::remove(uint64_t sequence) {
+    lock_guard<mutex> lock(mutex_);
+
+    auto it = find_if(entries_.begin(), entries_.end(),
+                      [sequence](const Entry &entry) {
+                          return entry.sequence == sequence;
+                      });
+    if (it == entries_.end()) {
+        return;
+    }
+    entries_.erase(it);
+    if (!directory_.empty()) {
+        ::remove(path(sequence).c_str());
+    }
+}
+
+void Outbox::retry(uint64_t sequence, Clock::time_point next_attempt) {
+    lock_guard<mutex> lock(mutex_);
+
+    for (auto &entry : entries_) {
+        if (entry.sequence == sequence) {
+            ++entry.attempts;
+            entry.next_attempt = next_attempt;
+            write(entry);
+            return;
+        }
+    }
+}
+
+bool Outbox::state(const string &owner, const string &target, Action add,
+                   Action remove, bool &present) const {
+    lock_guard<mutex> lock(mutex_);
+
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        if (it->owner != owner || it->target != target) {
+            continue;
+        }
+        if (it->action == add || it->action == remove) {
+            present = it->action == add;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Outbox::queued(const string &owner, const string &target,
+                    Action action) const {
+    lock_guard<mutex> lock(mutex_);
+
+    return any_of(entries_.begin(), entries_.end(),
+                  [&](const Entry &entry) {
+                      return entry.owner == owner && entry.target == target
+                              && entry.action == action;
+                  });
+}
+
+deque<Outbox::Entry> Outbox::entries() const {
+    lock_guard<mutex> lock(mutex_);
+    return entries_;
+}
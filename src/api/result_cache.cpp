@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/result_cache.h>
+
+using namespace api;
+using namespace std;
+
+size_t api::approximate_size(const User &user) {
+    return sizeof(User) + user.title().capacity() + user.artwork().capacity()
+            + user.permalink_url().capacity() + user.bio().capacity();
+}
+
+size_t api::approximate_size(const Track &track) {
+    return sizeof(Track) + approximate_size(track.user()) - sizeof(User)
+            + track.title().capacity() + track.description().capacity()
+            + track.artwork().capacity() + track.waveform().capacity()
+            + track.uri().capacity() + track.label_name().capacity()
+            + track.license().capacity() + track.created_at().capacity()
+            + track.permalink_url().capacity()
+            + track.purchase_url().capacity()
+            + track.stream_url().capacity()
+            + track.download_url().capacity()
+            + track.video_url().capacity() + track.genre().capacity()
+            + track.original_format().capacity();
+}
+
+size_t api::approximate_size(const Comment &comment) {
+    return sizeof(Comment) + approximate_size(comment.user()) - sizeof(User)
+            + comment.body().capacity() + comment.created_at().capacity();
+}
+
+ResultCache::ResultCache(size_t max_bytes) :
+        max_bytes_(max_bytes) {
+}
+
+void ResultCache::insert(Item &&item) {
+    auto it = index_.find(item.key);
+    if (it != index_.end()) {
+        erase(it->second);
+    }
+    if (item.bytes > max_bytes_) {
+        return;
+    }
+
+    while (!lru_.empty() && statistics_.bytes + item.bytes > max_bytes_) {
+        erase(prev(lru_.end()));
+    }
+
+    statistics_.bytes += item.bytes;
+    ++statistics_.entries;
+    lru_.emplace_front(move(item));
+    index_[lru_.front().key] = lru_.begin();
+}
+
+void ResultCache::erase(list<Item>::iterator it) {
+    statistics_.bytes -= it->bytes;
+    --statistics_.entries;
+    index_.erase(it->key);
+    lru_.erase(it);
+}
+
+void ResultCache::remove(const string &key) {
+    lock_guard<mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        erase(it->second);
+    }
+}
+
+void ResultCache::remove_prefix(const string &prefix) {
+    lock_guard<mutex> lock(mutex_);
+    for (auto it = lru_.begin(); it != lru_.end();) {
+        auto current = it++;
+        if (current->key.compare(0, prefix.size(), prefix) == 0) {
+            erase(current);
+        }
+    }
+}
+
+void ResultCache::clear() {
+    lock_guard<mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    statistics_.bytes = 0;
+    statistics_.entries = 0;
+}
+
+ResultCache::Statistics ResultCache::statistics() const {
+    lock_guard<mutex> lock(mutex_);
+    return statistics_;
+}
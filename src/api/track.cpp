@@ -35,10 +35,6 @@ Track::Track(const json::Value &data) :
     duration_ = data["duration"].asUInt();
     license_ = data["license"].asString();
     created_at_ = data["created_at"].asString();
-    
-    std::vector<std::string> created_time;
-    boost::split(created_time, created_at_, boost::is_any_of(" "));
-    created_at_ = created_time[0];
 
     playback_count_ = data["playback_count"].asUInt();
     favoritings_count_ = data["favoritings_count"].asUInt();
@@ -48,13 +44,7 @@ Track::Track(const json::Value &data) :
 
     artwork_ = data["artwork_url"].asString();
     waveform_ = data["waveform_url"].asString();
-    //when loading login user stream, server gives waveform 
-    //sample json file instread of image
-    if (boost::algorithm::ends_with(waveform_, "json")) {
-        boost::replace_all(waveform_, "json", "png");
-	boost::replace_all(waveform_, "is.", "1.");
-    }    
-    
+
     streamable_ = data["streamable"].asBool();
     downloadable_ = data["downloadable"].asBool();
 
@@ -66,6 +56,21 @@ Track::Track(const json::Value &data) :
 
     genre_ = data["genre"].asString();
     original_format_ = data["original_format"].asString();
+
+    normalize();
+}
+
+void Track::normalize() {
+    std::vector<std::string> created_time;
+    boost::split(created_time, created_at_, boost::is_any_of(" "));
+    created_at_ = created_time[0];
+
+    //when loading login user stream, server gives waveform 
+    //sample json file instread of image
+    if (boost::algorithm::ends_with(waveform_, "json")) {
+        boost::replace_all(waveform_, "json", "png");
+	boost::replace_all(waveform_, "is.", "1.");
+    }    
 }
 
 const string & Track::title() const {
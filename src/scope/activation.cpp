@@ -21,6 +21,7 @@
 #include <unity/scopes/ActivationResponse.h>
 #include <unity/scopes/ActionMetadata.h>
 
+#include <chrono>
 #include <iostream>
 
 namespace sc = unity::scopes;
@@ -29,9 +30,13 @@ using namespace std;
 using namespace scope;
 using namespace api;
 
+/**
+ * Wait for @a f until the action runs out of time. The client aborts the
+ * request then.
+ */
 template<typename T>
-static T get_or_throw(future<T> &f) {
-    if (f.wait_for(std::chrono::seconds(10)) != future_status::ready) {
+static T get_or_throw(future<T> &f, const Client &client) {
+    if (f.wait_until(client.deadline()) != future_status::ready) {
         throw domain_error("HTTP request timeout");
     }
     return f.get();
@@ -40,10 +45,20 @@ static T get_or_throw(future<T> &f) {
 Activation::Activation(const sc::Result &result,
                const sc::ActionMetadata &metadata,
                std::string const& action_id,
-               std::shared_ptr<sc::OnlineAccountClient> oa_client) : 
+               const Client &client,
+               const chrono::milliseconds &budget,
+               const shared_ptr<void> &busy,
+               const PreviewCache::Ptr &cache) :
     sc::ActivationQueryBase(result, metadata), 
     action_id_(action_id),
-    client_(oa_client) {
+    client_(client.session()),
+    busy_(busy),
+    cache_(cache) {
+    client_.set_deadline(chrono::steady_clock::now() + budget);
+}
+
+void Activation::cancelled() {
+    client_.cancel();
 }
 
 sc::ActivationResponse Activation::activate() {
@@ -54,32 +69,49 @@ sc::ActivationResponse Activation::activate() {
         if (action_id_ == "commented") {
             string comments = action_metadata().scope_data().get_dict()["comment"].get_string();
             future<bool> post_future = client_.post_comment(trackid, comments);
-            auto status = get_or_throw(post_future);
+            auto status = get_or_throw(post_future, client_);
             cout<< "auth user post a comment: " << status << endl;
+            if (cache_) {
+                // Not cached again until the comment is sent and the
+                // list fetched with it
+                cache_->erase(trackid);
+            }
 
             return sc::ActivationResponse(sc::ActivationResponse::Status::ShowPreview);
         } else if (action_id_ == "like") {
             future<bool> like_future = client_.like_track(trackid);
-            auto status = get_or_throw(like_future);
+            auto status = get_or_throw(like_future, client_);
             cout<< "auth user likes track: " << status << endl;
+            if (cache_ && status) {
+                cache_->set_liked(client_.owner(), trackid, true);
+            }
 
             return sc::ActivationResponse(sc::ActivationResponse::Status::ShowPreview);
         } else if (action_id_ == "deletelike") {
             future<bool> ret_future = client_.delete_like_track(trackid);
-            auto status = get_or_throw(ret_future);
+            auto status = get_or_throw(ret_future, client_);
             cout<< "auth user delete a like track: " << status << endl;
+            if (cache_ && status) {
+                cache_->set_liked(client_.owner(), trackid, false);
+            }
 
             return sc::ActivationResponse(sc::ActivationResponse::Status::ShowPreview);
         } else if (action_id_ == "follow") {
             future<bool> follow_future = client_.follow_user(userid);
-            auto status = get_or_throw(follow_future);
+            auto status = get_or_throw(follow_future, client_);
             cout<< "auth user follow user: " << status << endl;
+            if (cache_ && status) {
+                cache_->set_following(client_.owner(), userid, true);
+            }
 
             return sc::ActivationResponse(sc::ActivationResponse::Status::ShowPreview);
         } else if (action_id_ == "unfollow") {
             future<bool> unfollow_future = client_.unfollow_user(userid);
-            auto status = get_or_throw(unfollow_future);
+            auto status = get_or_throw(unfollow_future, client_);
             cout<< "auth user unfollow user: " << status << endl;
+            if (cache_ && status) {
+                cache_->set_following(client_.owner(), userid, false);
+            }
 
             return sc::ActivationResponse(sc::ActivationResponse::Status::ShowPreview);
         }
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <scope/prefetcher.h>
+
+#include <iostream>
+
+using namespace api;
+using namespace scope;
+using namespace std;
+using namespace std::chrono;
+
+Prefetcher::Prefetcher(const PreviewCache::Ptr &cache,
+                       const milliseconds &budget) :
+        cache_(cache), budget_(budget) {
+    thread_ = thread(&Prefetcher::run, this);
+}
+
+Prefetcher::~Prefetcher() {
+    stop();
+}
+
+void Prefetcher::prefetch(const Client &session,
+                          const vector<Target> &targets) {
+    auto job = make_shared<Job>();
+    job->session = make_shared<Client>(session);
+    job->targets = targets;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        // The user has moved on from the previous results
+        if (running_) {
+            running_->cancel();
+        }
+        next_ = job;
+    }
+    wake_.notify_all();
+}
+
+void Prefetcher::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+        if (running_) {
+            running_->cancel();
+        }
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Prefetcher::run() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] {
+            return stopping_ || next_;
+        });
+        if (stopping_) {
+            return;
+        }
+        shared_ptr<Job> job = move(next_);
+        running_ = job->session;
+        lock.unlock();
+
+        Client &session = *job->session;
+        session.set_deadline(steady_clock::now() + budget_);
+        unsigned int fetched = 0;
+        for (const auto &target : job->targets) {
+            if (steady_clock::now() >= session.deadline()) {
+                break;
+            }
+            // Once cancelled, the rest fail without a round-trip
+            try {
+                fetch(session, target);
+                ++fetched;
+            } catch (exception &e) {
+                cerr << "SoundCloud prefetch: track " << target.trackid
+                     << ": " << e.what() << endl;
+            }
+        }
+        cerr << "SoundCloud prefetch: " << fetched << "/"
+             << job->targets.size() << " previews" << endl;
+
+        lock.lock();
+        running_.reset();
+    }
+}
+
+void Prefetcher::fetch(Client &session, const Target &target) {
+    uint64_t writes = cache_->writes();
+    PreviewCache::Entry entry;
+    entry.owner = session.owner();
+    entry.userid = target.userid;
+
+    future<bool> like_future;
+    future<bool> follow_future;
+    if (!entry.owner.empty()) {
+        like_future = session.is_fav_track(target.trackid);
+        follow_future = session.is_user_follower(target.userid);
+    }
+    future<deque<Comment>> comment_future = session.track_comments(
+            target.trackid);
+
+    entry.comments = comment_future.get();
+    if (like_future.valid()) {
+        entry.liked = like_future.get();
+        entry.following = follow_future.get();
+    }
+    // The list may not have the user's own comment yet
+    if (entry.owner.empty() || !session.comment_queued(target.trackid)) {
+        cache_->put(target.trackid, entry, writes);
+    }
+}
@@ -30,6 +30,7 @@
 #include <unity/scopes/Result.h>
 #include <unity/scopes/VariantBuilder.h>
 
+#include <chrono>
 #include <iostream>
 
 namespace sc = unity::scopes;
@@ -38,21 +39,59 @@ using namespace std;
 using namespace scope;
 using namespace api;
 
+/**
+ * Comment widgets a track preview has room for. This is also the size of
+ * the page SoundCloud returns by default.
+ */
+static const int MAX_COMMENTS = 50;
+
+template<typename T>
+static bool is_ready(future<T> &f) {
+    return f.valid() && f.wait_for(chrono::seconds(0)) == future_status::ready;
+}
+
 template<typename T>
-static T get_or_throw(future<T> &f) {
-    if (f.wait_for(std::chrono::seconds(10)) != future_status::ready) {
-        throw domain_error("HTTP request timeout");
+static future<T> ready(const T &value) {
+    promise<T> prom;
+    prom.set_value(value);
+    return prom.get_future();
+}
+
+/**
+ * Wait for @a f until the preview runs out of time. Returns false if the
+ * result did not make it, so that the preview goes out without it.
+ */
+template<typename T>
+static bool get_in_time(future<T> &f, const Client &client, T &value) {
+    if (f.wait_until(client.deadline()) != future_status::ready) {
+        return false;
+    }
+    try {
+        value = f.get();
+        return true;
+    } catch (exception &) {
+        // Aborted by the client at the deadline
+        if (chrono::steady_clock::now() < client.deadline()) {
+            throw;
+        }
+        return false;
     }
-    return f.get();
 }
 
 Preview::Preview(const sc::Result &result, const sc::ActionMetadata &metadata,
-                std::shared_ptr<sc::OnlineAccountClient> oa_client) :
+                const Client &client, const chrono::milliseconds &budget,
+                const shared_ptr<void> &busy, const PreviewCache::Ptr &cache) :
     sc::PreviewQueryBase(result, metadata),
-    client_(oa_client) {
+    client_(client.session()),
+    waker_(make_shared<Waker>()),
+    busy_(busy),
+    cache_(cache) {
+    client_.set_deadline(chrono::steady_clock::now() + budget);
+    client_.set_waker(waker_);
 }
 
 void Preview::cancelled() {
+    client_.cancel();
 }
 
 void Preview::run(sc::PreviewReplyProxy const& reply) {
@@ -114,7 +153,38 @@ void Preview::run(sc::PreviewReplyProxy const& reply) {
             }
             actions.add_attribute_value("actions", builder.end());
             widgets.emplace_back(actions);
+
+            layout1col.add_column(ids);
+            reply->register_layout( { layout1col }); //, layout2col, layout3col
+            reply->push(widgets);
         } else {
+            std::string trackid = res["id"].get_string();
+            std::string userid  = res["userid"].get_string();
+            bool authenticated = client_.authenticated();
+
+            // Get all the requests going before building anything, unless
+            // the answers were fetched ahead
+            future<bool> like_future;
+            future<bool> follow_future;
+            future<deque<Comment>> comment_future;
+            string owner = cache_ ? client_.owner() : string();
+            uint64_t writes = cache_ ? cache_->writes() : 0;
+            PreviewCache::Entry cached;
+            bool from_cache = cache_ && cache_->get(trackid, owner, cached);
+            if (from_cache) {
+                if (authenticated) {
+                    like_future = ready(cached.liked);
+                    follow_future = ready(cached.following);
+                }
+                comment_future = ready(cached.comments);
+            } else {
+                if (authenticated) {
+                    like_future = client_.is_fav_track(trackid);
+                    follow_future = client_.is_user_follower(userid);
+                }
+                comment_future = client_.track_comments(trackid);
+            }
+
             ids = std::vector<std::string> { "header", "art", "statistics", "trackinfo", "tracks", "description", "actions"};
 
             sc::PreviewWidget header("header", "header");
@@ -142,9 +212,6 @@ void Preview::run(sc::PreviewReplyProxy const& reply) {
                     res["comment-count"].get_string()));
             widgets.emplace_back(statistics);
 
-            std::string trackid = res["id"].get_string();
-            std::string userid  = res["userid"].get_string();
-
             sc::PreviewWidget tracks("tracks", "audio");
             {
                 if (res["streamable"].get_bool()) {
@@ -159,7 +226,7 @@ void Preview::run(sc::PreviewReplyProxy const& reply) {
                 }
             }
 
-            if (!client_.authenticated()) {
+            if (!authenticated) {
                 ids.emplace_back("tips-headerid");
                 sc::PreviewWidget w_tips(ids.at(ids.size() - 1), "text");
                 w_tips.add_attribute_value("text", sc::Variant(_("Please log-in to post a comment")));
@@ -191,103 +258,184 @@ void Preview::run(sc::PreviewReplyProxy const& reply) {
             description.add_attribute_mapping("text", "description");
             widgets.emplace_back(description);
 
-            if (client_.authenticated()) {
+            if (authenticated) {
                 ids.emplace_back("comment-inputid");
                 sc::PreviewWidget w_commentInput(ids.at(ids.size() - 1), "comment-input");
                 w_commentInput.add_attribute_value("submit-label", sc::Variant(_("Post")));
                 widgets.emplace_back(w_commentInput);
+            } else {
+                // Nothing to wait for
+                widgets.emplace_back(track_actions(false, false));
             }
 
-            sc::VariantBuilder builder;
-            sc::PreviewWidget actions("actions", "actions");
-            {
-                string purchase_url = res["purchase-url"].get_string();
-                if (!purchase_url.empty()) {
-                    builder.add_tuple({
-                          {"id", sc::Variant("buy")},
-                          {"label", sc::Variant(_("Buy"))},
-                          {"uri", sc::Variant(purchase_url)}
-                      });
-                }
-                string video_url = res["video-url"].get_string();
-                if (!video_url.empty()) {
-                    builder.add_tuple({
-                          {"id", sc::Variant("video")},
-                          {"label", sc::Variant(_("Watch video"))},
-                          {"uri", sc::Variant(video_url)}
-                      });
-                }
-                {
-                    builder.add_tuple({
-                          {"id", sc::Variant("play")},
-                          {"label", sc::Variant(_("Play in browser"))}
-                      });
-                }
-                if (client_.authenticated()) {
-                    sc::CannedQuery new_query(SCOPE_NAME);
-                    new_query.set_department_id("userid:" + userid);
-                    builder.add_tuple({
-                          {"id", sc::Variant("usertracks")},
-                          {"label", sc::Variant(_("Get user tracks"))},
-                          {"uri", sc::Variant(new_query.to_uri())}
-                      });
+            // The layout has to be complete before the first push, so leave
+            // room for as many comments as we show
+            for (int index = 0; index < MAX_COMMENTS; ++index) {
+                ids.emplace_back("commentId_" + std::to_string(index));
+            }
+
+            layout1col.add_column(ids);
+            reply->register_layout( { layout1col }); //, layout2col, layout3col
+            if (!reply->push(widgets)) {
+                return;
+            }
+
+            // The rest follows as soon as its requests are done, whichever
+            // finishes first
+            bool reading_actions = authenticated;
+            bool reading_comments = true;
+
+            // Kept for the next time, if it all came in
+            PreviewCache::Entry fetched;
+            fetched.owner = owner;
+            fetched.userid = userid;
+            bool complete = true;
+
+            while (reading_actions || reading_comments) {
+                // Anything that comes in from here on ends the wait below
+                uint64_t seen = waker_->count();
+                bool out_of_time = chrono::steady_clock::now() >= client_.deadline();
+
+                if (reading_actions && (out_of_time
+                        || (is_ready(like_future) && is_ready(follow_future)))) {
+                    reading_actions = false;
+
+                    // Without an answer in time, offer the plain actions
+                    bool liked = false;
+                    if (!get_in_time(like_future, client_, liked)) {
+                        cerr << "Track like state not available in time" << endl;
+                        complete = false;
+                    }
+                    cout << "is fav stats: " << liked << endl;
 
-                    future<bool> like_future = client_.is_fav_track(trackid);
-                    auto status = get_or_throw(like_future);
-                    cout << "is fav stats: " << status << endl;
-                    if (status == true) {
-                        builder.add_tuple({
-                              {"id", sc::Variant("deletelike")},
-                              {"label", sc::Variant(_("Remove 'Like'"))}
-                          });
-                    } else {
-                        builder.add_tuple({
-                              {"id", sc::Variant("like")},
-                              {"label", sc::Variant(_("Like"))}
-                          });
+                    bool following = false;
+                    if (!get_in_time(follow_future, client_, following)) {
+                        cerr << "User follow state not available in time" << endl;
+                        complete = false;
                     }
+                    cout << "is users follower: " << following << endl;
+                    fetched.liked = liked;
+                    fetched.following = following;
 
-                    future<bool> follow_future = client_.is_user_follower(userid);
-                    status = get_or_throw(follow_future);
-                    cout << "is users follower: " << status << endl;
-                    if (status == true) {
-                        builder.add_tuple({
-                              {"id", sc::Variant("unfollow")},
-                              {"label", sc::Variant(_("Unfollow"))}
-                          });
-                    } else {
-                        builder.add_tuple({
-                              {"id", sc::Variant("follow")},
-                              {"label", sc::Variant(_("Follow"))}
-                          });
+                    if (!reply->push({ track_actions(liked, following) })) {
+                        return;
+                    }
+                }
+
+                if (reading_comments && (out_of_time || is_ready(comment_future))) {
+                    reading_comments = false;
+
+                    deque<Comment> comments;
+                    if (!get_in_time(comment_future, client_, comments)) {
+                        cerr << "Track comments not available in time" << endl;
+                        complete = false;
+                    }
+                    fetched.comments = comments;
+                    sc::PreviewWidgetList comment_widgets = track_comments(comments);
+                    if (!comment_widgets.empty() && !reply->push(comment_widgets)) {
+                        return;
                     }
                 }
+
+                if (reading_actions || reading_comments) {
+                    waker_->wait_until(seen, client_.deadline());
+                }
             }
-            actions.add_attribute_value("actions", builder.end());
-            widgets.emplace_back(actions);
 
-            future<deque<Comment>> comment_future;
-            comment_future = client_.track_comments(trackid);
-
-            int index = 0;
-            for (const auto &comment : get_or_throw(comment_future)) {
-                std::string id = "commentId_"+ std::to_string(index++);
-                ids.emplace_back(id);
-
-                sc::PreviewWidget w_comment(id, "comment");
-                w_comment.add_attribute_value("comment", sc::Variant(comment.body()));
-                w_comment.add_attribute_value("author", sc::Variant(comment.title()));
-                w_comment.add_attribute_value("source", sc::Variant(comment.artwork()));
-                w_comment.add_attribute_value("subtitle", sc::Variant(comment.created_at()));
-                widgets.emplace_back(w_comment);
+            // The list may not have the user's own comment yet
+            if (cache_ && !from_cache && complete
+                    && !(authenticated && client_.comment_queued(trackid))) {
+                cache_->put(trackid, fetched, writes);
             }
         }
-
-        layout1col.add_column(ids);
-        reply->register_layout( { layout1col }); //, layout2col, layout3col
-        reply->push(widgets);
     }catch (domain_error &e) {
         cerr << e.what() << endl;
         reply->error(current_exception());
     }
 }
+
+sc::PreviewWidget Preview::track_actions(bool liked, bool following) {
+    auto const res = result();
+    std::string userid  = res["userid"].get_string();
+
+    sc::VariantBuilder builder;
+    sc::PreviewWidget actions("actions", "actions");
+    {
+        string purchase_url = res["purchase-url"].get_string();
+        if (!purchase_url.empty()) {
+            builder.add_tuple({
+                  {"id", sc::Variant("buy")},
+                  {"label", sc::Variant(_("Buy"))},
+                  {"uri", sc::Variant(purchase_url)}
+              });
+        }
+        string video_url = res["video-url"].get_string();
+        if (!video_url.empty()) {
+            builder.add_tuple({
+                  {"id", sc::Variant("video")},
+                  {"label", sc::Variant(_("Watch video"))},
+                  {"uri", sc::Variant(video_url)}
+              });
+        }
+        {
+            builder.add_tuple({
+                  {"id", sc::Variant("play")},
+                  {"label", sc::Variant(_("Play in browser"))}
+              });
+        }
+        if (client_.authenticated()) {
+            sc::CannedQuery new_query(SCOPE_NAME);
+            new_query.set_department_id("userid:" + userid);
+            builder.add_tuple({
+                  {"id", sc::Variant("usertracks")},
+                  {"label", sc::Variant(_("Get user tracks"))},
+                  {"uri", sc::Variant(new_query.to_uri())}
+              });
+
+            if (liked) {
+                builder.add_tuple({
+                      {"id", sc::Variant("deletelike")},
+                      {"label", sc::Variant(_("Remove 'Like'"))}
+                  });
+            } else {
+                builder.add_tuple({
+                      {"id", sc::Variant("like")},
+                      {"label", sc::Variant(_("Like"))}
+                  });
+            }
+
+            if (following) {
+                builder.add_tuple({
+                      {"id", sc::Variant("unfollow")},
+                      {"label", sc::Variant(_("Unfollow"))}
+                  });
+            } else {
+                builder.add_tuple({
+                      {"id", sc::Variant("follow")},
+                      {"label", sc::Variant(_("Follow"))}
+                  });
+            }
+        }
+    }
+    actions.add_attribute_value("actions", builder.end());
+    return actions;
+}
+
+sc::PreviewWidgetList Preview::track_comments(const deque<Comment> &comments) {
+    sc::PreviewWidgetList widgets;
+    int index = 0;
+    for (const auto &comment : comments) {
+        if (index == MAX_COMMENTS) {
+            break;
+        }
+        std::string id = "commentId_"+ std::to_string(index++);
+
+        sc::PreviewWidget w_comment(id, "comment");
+        w_comment.add_attribute_value("comment", sc::Variant(comment.body()));
+        w_comment.add_attribute_value("author", sc::Variant(comment.title()));
+        w_comment.add_attribute_value("source", sc::Variant(comment.artwork()));
+        w_comment.add_attribute_value("subtitle", sc::Variant(comment.created_at()));
+        widgets.emplace_back(w_comment);
+    }
+    return widgets;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <scope/preview_cache.h>
+
+using namespace api;
+using namespace scope;
+using namespace std;
+
+PreviewCache::PreviewCache(size_t capacity, Clock::duration max_age) :
+        capacity_(capacity), max_age_(max_age) {
+}
+
+bool PreviewCache::get(const string &trackid, const string &owner,
+                       Entry &entry) {
+    lock_guard<mutex> lock(mutex_);
+    auto found = index_.find(trackid);
+    if (found == index_.end()) {
+        return false;
+    }
+    Entries::iterator it = found->second;
+    if (Clock::now() >= it->expiry) {
+        erase(it);
+        return false;
+    }
+    if (it->entry.owner != owner) {
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it);
+    entry = it->entry;
+    return true;
+}
+
+void PreviewCache::put(const string &trackid, const Entry &entry,
+                       uint64_t writes) {
+    lock_guard<mutex> lock(mutex_);
+    auto found = index_.find(trackid);
+    if (found != index_.end()) {
+        erase(found->second);
+    }
+    if (capacity_ == 0 || (writes != UINT64_MAX && writes != writes_)) {
+        return;
+    }
+    Slot slot;
+    slot.trackid = trackid;
+    slot.entry = entry;
+    slot.expiry = Clock::now() + max_age_;
+    entries_.emplace_front(slot);
+    index_[trackid] = entries_.begin();
+    while (entries_.size() > capacity_) {
+        erase(prev(entries_.end()));
+    }
+}
+
+uint64_t PreviewCache::writes() const {
+    lock_guard<mutex> lock(mutex_);
+    return writes_;
+}
+
+void PreviewCache::set_liked(const string &owner, const string &trackid,
+                             bool liked) {
+    lock_guard<mutex> lock(mutex_);
+    ++writes_;
+    auto found = index_.find(trackid);
+    if (found != index_.end() && found->second->entry.owner == owner) {
+        found->second->entry.liked = liked;
+    }
+}
+
+void PreviewCache::set_following(const string &owner, const string &userid,
+                                 bool following) {
+    lock_guard<mutex> lock(mutex_);
+    ++writes_;
+    for (auto &slot : entries_) {
+        if (slot.entry.owner == owner && slot.entry.userid == userid) {
+            slot.entry.following = following;
+        }
+    }
+}
+
+void PreviewCache::erase(const string &trackid) {
+    lock_guard<mutex> lock(mutex_);
+    ++writes_;
+    auto found = index_.find(trackid);
+    if (found != index_.end()) {
+        erase(found->second);
+    }
+}
+
+void PreviewCache::erase(Entries::iterator it) {
+    index_.erase(it->trackid);
+    entries_.erase(it);
+}
+
+size_t PreviewCache::size() const {
+    lock_guard<mutex> lock(mutex_);
+    return entries_.size();
+}
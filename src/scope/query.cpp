@@ -20,6 +20,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
+#include <api/hotness.h>
 #include <scope/localization.h>
 #include <scope/query.h>
 
@@ -31,10 +32,12 @@
 #include <unity/scopes/SearchReply.h>
 #include <unity/scopes/VariantBuilder.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <ctime>
+#include <functional>
 
 namespace sc = unity::scopes;
 namespace alg = boost::algorithm;
@@ -155,14 +158,50 @@ static const vector<string> MUSIC_DEPARTMENT_NAMES { _("Home"), _(
                 "Tech House"), _("Techno"), _("Trance"), _("Trap"), _(
                 "Trip Hop"), _("World") };
 
+/**
+ * Time each genre merged into the home page may take. Those still out
+ * then are left out, so that one slow genre cannot hold up the category.
+ */
+static const milliseconds HOME_GENRE_BUDGET(5000);
+
+/**
+ * Tracks in the Explore category
+ */
+static const unsigned int EXPLORE_TRACKS = 15;
+
+/**
+ * Search results whose previews are fetched ahead, about as many as fit
+ * on the screen
+ */
+static const size_t PREFETCH_TRACKS = 6;
+
+template<typename T>
+static bool is_ready(future<T> &f) {
+    return f.valid() && f.wait_for(seconds(0)) == future_status::ready;
+}
+
+/**
+ * Wait for @a f until @a deadline at the latest, and get it
+ */
 template<typename T>
-static T get_or_throw(future<T> &f) {
-    if (f.wait_for(std::chrono::seconds(10)) != future_status::ready) {
-        throw domain_error("HTTP request timeout");
+static T get_by(future<T> &f, const steady_clock::time_point &deadline) {
+    if (f.wait_until(deadline) != future_status::ready) {
+        throw domain_error("Request deadline exceeded");
     }
     return f.get();
 }
 
+/**
+ * Called while handling the failure of one of the query's requests. Those
+ * aborted because the query ran out of time are dropped, so that whatever
+ * was pushed before stands; anything else is rethrown.
+ */
+static void rethrow_unless_out_of_time(const Client &client) {
+    if (steady_clock::now() < client.deadline()) {
+        throw;
+    }
+}
+
 static sc::Department::SPtr create_departments(const sc::CannedQuery &query,
                                                bool contains_fav) {
     sc::Department::SPtr root_department = sc::Department::create("", query,
@@ -193,6 +232,34 @@ static string department_to_category(const string &department) {
     return id;
 }
 
+/**
+ * The genres of @a genres that we have departments for
+ */
+static vector<string> known_genres(const vector<string> &genres) {
+    vector<string> known;
+    for (const auto &genre : genres) {
+        if (find(MUSIC_DEPARTMENT_IDS.begin(), MUSIC_DEPARTMENT_IDS.end(), genre)
+                != MUSIC_DEPARTMENT_IDS.end()
+                || find(AUDIO_DEPARTMENT_IDS.begin(), AUDIO_DEPARTMENT_IDS.end(), genre)
+                != AUDIO_DEPARTMENT_IDS.end()) {
+            known.emplace_back(genre);
+        }
+    }
+    return known;
+}
+
+/**
+ * The genres the Explore category of a genre department (or the home
+ * page) draws its hottest tracks from
+ */
+static vector<string> explore_genres(const string &department_id,
+                                     const vector<string> &home_genres) {
+    if (department_id.empty() && !home_genres.empty()) {
+        return home_genres;
+    }
+    return { department_to_category(department_id) };
+}
+
 static string format_fixed(unsigned int i) {
     std::stringstream ss;
     ss.imbue(std::locale(""));
@@ -224,13 +291,90 @@ static string format_time(unsigned int t) {
 }
 
 Query::Query(const sc::CannedQuery &query, const sc::SearchMetadata &metadata,
-             std::shared_ptr<sc::OnlineAccountClient> oa_client) :
+             const Client &client, const milliseconds &budget,
+             const vector<string> &home_genres, const shared_ptr<void> &busy,
+             const Snapshot::Ptr &snapshot, const Prefetcher::Ptr &prefetcher) :
         sc::SearchQueryBase(query, metadata),
-        client_(oa_client) {
+        client_(client.session()), waker_(make_shared<Waker>()),
+        home_genres_(known_genres(home_genres)),
+        busy_(busy), snapshot_(snapshot), prefetcher_(prefetcher),
+        prefetch_session_(client.session()) {
+    client_.set_deadline(steady_clock::now() + budget);
+    client_.set_waker(waker_);
+}
+
+Query::~Query() {
+    // Only when asked for, it is a line per query
+    if (!getenv("SOUNDCLOUD_SCOPE_STATISTICS")) {
+        return;
+    }
+    Client::Statistics statistics = client_.statistics();
+    unsigned int lookups = statistics.result_cache_hits
+            + statistics.result_cache_misses;
+    cerr << "SoundCloud query: " << statistics.credential_lookups
+         << " credential lookups, " << statistics.credential_lookups_saved
+         << " saved; result cache hit ratio " << statistics.result_cache_hits
+         << "/" << lookups << ", " << statistics.result_cache_bytes
+         << " bytes held; " << statistics.coalesced
+         << " requests coalesced" << endl;
+}
+
+void Query::warm(Client &client, const string &department_id,
+                 const vector<string> &home_genres) {
+    if (alg::starts_with(department_id, "userid:")) {
+        return;
+    }
+
+    future<User> user_future;
+    future<deque<Track>> stream_future;
+    if (department_id.empty() && client.authenticated()) {
+        user_future = client.get_authuser_info();
+        stream_future = client.stream_tracks(30);
+    }
+
+    vector<future<deque<Track>>> explore;
+    if (department_id == "my_fav") {
+        // Only the first page: the rest follows while the user looks
+        if (client.authenticated()) {
+            explore.emplace_back(client.favorite_track_pages()->next());
+        }
+    } else {
+        for (const auto &genre : explore_genres(department_id,
+                                                known_genres(home_genres))) {
+            explore.emplace_back(client.hot_tracks(genre, EXPLORE_TRACKS));
+        }
+    }
+
+    // Wait for everything, but no longer than the session allows, before
+    // reporting the first failure
+    exception_ptr error;
+    auto wait = [&error](function<void()> get) {
+        try {
+            get();
+        } catch (...) {
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    };
+    steady_clock::time_point deadline = client.deadline();
+    if (user_future.valid()) {
+        wait([&] { get_by(user_future, deadline); });
+    }
+    if (stream_future.valid()) {
+        wait([&] { get_by(stream_future, deadline); });
+    }
+    for (auto &tracks : explore) {
+        wait([&] { get_by(tracks, deadline); });
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
 }
 
 void Query::cancelled() {
     client_.cancel();
+    prefetch_session_.cancel();
 }
 
 void Query::run(sc::SearchReplyProxy const& reply) {
@@ -256,6 +400,7 @@ void Query::run(sc::SearchReplyProxy const& reply) {
         sc::Category::SCPtr first_cat;
         sc::Category::SCPtr user_cat;
         future<deque<Track>> stream_future;
+        auto stream_channel = make_shared<Channel<Track>>(waker_);
         future<User> user_future;
         bool reading_stream = false;
         bool reading_user_info = false;
@@ -268,7 +413,7 @@ void Query::run(sc::SearchReplyProxy const& reply) {
                 first_cat = reply->register_category(
                     "stream", _("Stream"), "",
                     sc::CategoryRenderer(SEARCH_CATEGORY_TEMPLATE));
-                stream_future = client_.stream_tracks(30);
+                stream_future = client_.stream_tracks(30, stream_channel);
                 reading_stream = true;
                 reading_user_info = true;
             } else {
@@ -278,11 +423,16 @@ void Query::run(sc::SearchReplyProxy const& reply) {
 
         sc::Category::SCPtr second_cat;
         future<deque<Track>> tracks_future;
+        auto tracks_channel = make_shared<Channel<Track>>(waker_);
+        Client::TrackPager::Ptr tracks_pager;
+        HomeFeed home;
         if (query_string.empty()) {
             second_cat = reply->register_category("explore", _("Explore"), "",
                     sc::CategoryRenderer(SEARCH_CATEGORY_TEMPLATE));
             if (department_id == "my_fav") {
-                tracks_future = client_.favorite_tracks();
+                // All of them, not just the first page
+                tracks_pager = client_.favorite_track_pages();
+                tracks_future = tracks_pager->next();
             } else if (is_dummy_depts) {
                 //create dummy department to pass the validation check
                 user_cat = reply->register_category("user", "", "",
@@ -290,61 +440,195 @@ void Query::run(sc::SearchReplyProxy const& reply) {
 
                 string userId = department_id.substr(department_id.find(':') + 1);
                 user_future = client_.get_user_info(userId);
-                tracks_future = client_.get_user_tracks(userId, 15);
+                tracks_future = client_.get_user_tracks(userId, 15, tracks_channel);
                 reading_user_info = true;
             } else {
-                tracks_future = client_.search_tracks({
-                    { SP::query, query_string },
-                    { SP::limit, "15" },
-                    { SP::genre, department_to_category(department_id) },
-                    { SP::order, "hotness" }
-                });
+                vector<string> genres = explore_genres(department_id,
+                                                       home_genres_);
+                if (genres.size() > 1) {
+                    steady_clock::time_point genre_deadline = min(
+                            client_.deadline(),
+                            steady_clock::now() + HOME_GENRE_BUDGET);
+                    home.category = second_cat;
+                    for (const auto &genre : genres) {
+                        home.genres.emplace_back(
+                                client_.hot_tracks(genre, EXPLORE_TRACKS));
+                        home.deadlines.emplace_back(genre_deadline);
+                    }
+                    home.done = false;
+                } else {
+                    tracks_future = client_.hot_tracks(genres.front(),
+                                                       EXPLORE_TRACKS);
+                }
             }
         } else {
             second_cat = reply->register_category("search", "", "",
                     sc::CategoryRenderer(SEARCH_CATEGORY_TEMPLATE));
+            prefetching_ = bool(prefetcher_);
 
             tracks_future = client_.search_tracks( {
                  { SP::query, query_string },
                  { SP::limit, "30" }
-            });
+            }, tracks_channel);
         }
 
-        // Now we come to wait for the results
-        if (reading_user_info) {
-            User user = get_or_throw(user_future);
-            if (!push_user_info(reply, user_cat, user)) {
-                return;
-            }
+        // The surfacing page is shown from the snapshot of the last visit
+        // straight away, and refreshed behind it
+        string owner;
+        bool shown = false;
+        if (snapshot_ && query_string.empty() && department_id.empty()) {
+            owner = client_.owner();
         }
-
-        if (reading_stream) {
-            for (const auto &track : get_or_throw(stream_future)) {
-                if (!push_track(reply, first_cat, track)) {
+        // Logged out, there is no one to keep the page for
+        if (!owner.empty()) {
+            recording_ = true;
+            vector<Snapshot::Item> items;
+            if (snapshot_->get(owner, items)) {
+                if (!replay(reply, items, { user_cat, first_cat, second_cat })) {
                     return;
                 }
+                reply->finished();
+                shown = refreshing_ = true;
             }
         }
 
-        deque<Track> tracklist = get_or_throw(tracks_future);
-        for (const auto &track : tracklist) {
-            if (!push_track(reply, second_cat, track)) {
+        // Now we come to wait for the results. The categories are already
+        // registered, so each one can be filled as soon as its request is
+        // done, whichever finishes first.
+        TrackFeed stream;
+        stream.category = first_cat;
+        stream.tracks = move(stream_future);
+        stream.channel = stream_channel;
+        stream.done = !reading_stream;
+
+        TrackFeed tracks;
+        tracks.category = second_cat;
+        tracks.tracks = move(tracks_future);
+        tracks.channel = tracks_channel;
+        tracks.pager = tracks_pager;
+        tracks.done = !home.done;
+
+        while (reading_user_info || !stream.done || !tracks.done || !home.done) {
+            // Anything that comes in from here on ends the wait below
+            uint64_t seen = waker_->count();
+            bool progress = false;
+
+            if (reading_user_info && is_ready(user_future)) {
+                reading_user_info = false;
+                progress = true;
+                try {
+                    if (!push_user_info(reply, user_cat, user_future.get())) {
+                        return;
+                    }
+                } catch (exception &) {
+                    rethrow_unless_out_of_time(client_);
+                }
+            }
+
+            if (!pump_tracks(reply, stream, progress)
+                    || !pump_tracks(reply, tracks, progress)
+                    || !pump_home(reply, home, progress)) {
                 return;
             }
+
+            if (!progress) {
+                // The client aborts whatever is still running
+                steady_clock::time_point now = steady_clock::now();
+                steady_clock::time_point wake = client_.deadline();
+                if (now >= wake) {
+                    break;
+                }
+                // A home genre running out of time is news as well
+                if (!home.done) {
+                    for (const auto &deadline : home.deadlines) {
+                        if (deadline > now) {
+                            wake = min(wake, deadline);
+                        }
+                    }
+                }
+                waker_->wait_until(seen, wake);
+            }
         }
 
-        if (tracklist.size() == 0) {
-            if (!show_empty_tip(reply)) {
+        size_t explored = tracks.pushed + home.pushed;
+        if (steady_clock::now() >= client_.deadline()) {
+            cerr << "SoundCloud query: out of time after "
+                 << stream.pushed + explored << " tracks" << endl;
+            if (stream.pushed == 0 && explored == 0) {
+                throw domain_error("HTTP request timeout");
+            }
+        } else if (explored == 0) {
+            if (!refreshing_ && !show_empty_tip(reply)) {
                 return;
             }
+        } else if (recording_) {
+            // Only a complete page replaces the snapshot
+            snapshot_->put(owner, recorded_, shown);
+        }
+
+        // The results are out, so their previews are next
+        if (prefetching_ && !visible_.empty()) {
+            prefetcher_->prefetch(prefetch_session_, visible_);
         }
 
     } catch (domain_error &e) {
         cerr << e.what() << endl;
-        reply->error(current_exception());
+        // The snapshot stands
+        if (!refreshing_) {
+            reply->error(current_exception());
+        }
     }
 }
 
+bool Query::push(const sc::SearchReplyProxy &reply,
+                 const sc::CategorisedResult &result) {
+    if (recording_) {
+        Snapshot::Item item;
+        item.category = result.category()->id();
+        item.key = result.uri() + '\n' + result.title() + '\n' + result.art();
+        try {
+            item.result = sc::Variant(result.serialize()["attrs"]).serialize_json();
+            recorded_.emplace_back(item);
+        } catch (exception &e) {
+            // A page with a hole in it is not worth keeping
+            cerr << "SoundCloud query: not taking a snapshot: " << e.what() << endl;
+            recording_ = false;
+        }
+    }
+    if (refreshing_) {
+        return true;
+    }
+    return reply->push(result);
+}
+
+bool Query::replay(const sc::SearchReplyProxy &reply,
+                   const vector<Snapshot::Item> &items,
+                   const vector<sc::Category::SCPtr> &categories) {
+    for (const auto &item : items) {
+        auto category = find_if(categories.begin(), categories.end(),
+                                [&item](const sc::Category::SCPtr &category) {
+                                    return category && category->id() == item.category;
+                                });
+        if (category == categories.end()) {
+            continue;
+        }
+        sc::CategorisedResult result(*category);
+        try {
+            for (const auto &attribute : sc::Variant::deserialize_json(
+                    item.result).get_dict()) {
+                result[attribute.first] = attribute.second;
+            }
+        } catch (exception &e) {
+            cerr << "SoundCloud query: bad snapshot: " << e.what() << endl;
+            continue;
+        }
+        if (!reply->push(result)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool Query::push_track(const sc::SearchReplyProxy &reply,
                        const sc::Category::SCPtr &category,
                        const Track &track) {
@@ -404,7 +688,105 @@ bool Query::push_track(const sc::SearchReplyProxy &reply,
 
     res["mode"] = "track";
 
-    return reply->push(res);
+    if (prefetching_ && visible_.size() < PREFETCH_TRACKS) {
+        Prefetcher::Target target;
+        target.trackid = to_string(track.id());
+        target.userid = to_string(track.user().id());
+        visible_.emplace_back(target);
+    }
+
+    return push(reply, res);
+}
+
+bool Query::pump_tracks(const sc::SearchReplyProxy &reply, TrackFeed &feed,
+                        bool &progress) {
+    if (feed.done) {
+        return true;
+    }
+
+    // First cards go out while later ones are still being downloaded
+    for (const auto &track : feed.channel->take(seconds(0))) {
+        progress = true;
+        if (!push_track(reply, feed.category, track)) {
+            return false;
+        }
+        ++feed.pushed;
+    }
+
+    if (!is_ready(feed.tracks)) {
+        return true;
+    }
+
+    // Results served from a cache, or shared with another query, only
+    // come through the future
+    feed.done = true;
+    progress = true;
+    deque<Track> tracklist;
+    try {
+        tracklist = feed.tracks.get();
+    } catch (exception &) {
+        rethrow_unless_out_of_time(client_);
+        return true;
+    }
+    for (size_t i = feed.pushed - feed.page_start; i < tracklist.size(); ++i) {
+        if (!push_track(reply, feed.category, tracklist[i])) {
+            return false;
+        }
+        ++feed.pushed;
+    }
+
+    if (feed.pager && !feed.pager->exhausted()) {
+        feed.tracks = feed.pager->next();
+        feed.page_start = feed.pushed;
+        feed.done = false;
+    }
+    return true;
+}
+
+bool Query::pump_home(const sc::SearchReplyProxy &reply, HomeFeed &feed,
+                      bool &progress) {
+    if (feed.done) {
+        return true;
+    }
+    steady_clock::time_point now = steady_clock::now();
+    for (size_t i = 0; i < feed.genres.size(); ++i) {
+        if (!is_ready(feed.genres[i]) && now < feed.deadlines[i]) {
+            return true;
+        }
+    }
+
+    // Whatever is not in yet is left out
+    feed.done = true;
+    progress = true;
+    vector<deque<Track>> lists;
+    exception_ptr error;
+    for (auto &genre : feed.genres) {
+        if (!is_ready(genre)) {
+            continue;
+        }
+        try {
+            lists.emplace_back(genre.get());
+        } catch (exception &e) {
+            cerr << "SoundCloud query: genre failed: " << e.what() << endl;
+            error = current_exception();
+        }
+    }
+    if (lists.empty() && error) {
+        try {
+            rethrow_exception(error);
+        } catch (exception &) {
+            rethrow_unless_out_of_time(client_);
+        }
+    }
+
+    for (const auto &track : merge_hottest(lists, EXPLORE_TRACKS,
+                                           system_clock::now())) {
+        if (!push_track(reply, feed.category, track)) {
+            return false;
+        }
+        ++feed.pushed;
+    }
+    return true;
 }
 
 bool Query::push_user_info(const sc::SearchReplyProxy &reply,
@@ -436,7 +818,7 @@ bool Query::push_user_info(const sc::SearchReplyProxy &reply,
     res["attributes"] = builder.end();
     res["mode"] = "user";
 
-    return reply->push(res);
+    return push(reply, res);
 }
 
 bool Query::show_empty_tip(const unity::scopes::SearchReplyProxy &reply)
@@ -23,11 +23,92 @@
 #include <scope/scope.h>
 #include <scope/activation.h>
 
+#include <boost/algorithm/string.hpp>
+#include <gio/gio.h>
+
+#include <algorithm>
+
 namespace sc = unity::scopes;
 using namespace std;
 using namespace api;
 using namespace scope;
 
+/**
+ * Departments warmed at once in the background, the random pause added to
+ * the warmer's waits, and the time each department may take
+ */
+static const unsigned int WARM_CONCURRENCY = 2;
+
+static const chrono::milliseconds WARM_JITTER(3000);
+
+static const chrono::milliseconds WARM_BUDGET(30000);
+
+/**
+ * Tracks whose preview data is kept, and for how long; the comments are
+ * the part that goes stale. Then the time the preview data of the top
+ * search results may take to fetch.
+ */
+static const size_t PREVIEW_CACHE_TRACKS = 64;
+
+static const chrono::minutes PREVIEW_CACHE_MAX_AGE(5);
+
+static const chrono::milliseconds PREFETCH_BUDGET(20000);
+
+/**
+ * A time budget in milliseconds, from the environment if it is set there
+ */
+static chrono::milliseconds budget(const char *variable,
+                                   const chrono::milliseconds &fallback) {
+    const char *value = getenv(variable);
+    if (value == nullptr) {
+        return fallback;
+    }
+    try {
+        return chrono::milliseconds(stol(value));
+    } catch (logic_error &) {
+        cerr << "Invalid " << variable << ": " << value << endl;
+        return fallback;
+    }
+}
+
+/**
+ * Ask the shell to run the scope's queries again, over the session bus
+ */
+static void invalidate_results() {
+    GError *error = nullptr;
+    GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+    if (bus == nullptr) {
+        cerr << "Could not invalidate results: " << error->message << endl;
+        g_error_free(error);
+        return;
+    }
+    if (!g_dbus_connection_emit_signal(bus, nullptr,
+            "/com/canonical/unity/scopes", "com.canonical.unity.scopes",
+            "InvalidateResults", g_variant_new("(s)", SCOPE_NAME), &error)) {
+        cerr << "Could not invalidate results: " << error->message << endl;
+        g_error_free(error);
+    }
+    g_object_unref(bus);
+}
+
+/**
+ * A comma separated list from the environment, if it is set there
+ */
+static vector<string> names(const char *variable,
+                            const vector<string> &fallback) {
+    const char *value = getenv(variable);
+    if (value == nullptr) {
+        return fallback;
+    }
+    vector<string> items;
+    boost::algorithm::split(items, value, boost::algorithm::is_any_of(","));
+    for (auto &item : items) {
+        boost::algorithm::trim(item);
+    }
+    items.erase(remove(items.begin(), items.end(), string()), items.end());
+    return items;
+}
+
 void Scope::start(string const&) {
     setlocale(LC_ALL, "");
     string translation_directory = ScopeBase::scope_directory()
@@ -38,26 +119,79 @@ void Scope::start(string const&) {
         oa_client_.reset(new sc::OnlineAccountClient(
             SCOPE_NAME, "sharing", SCOPE_ACCOUNTS_NAME));
     }
+
+    string cache_directory;
+    try {
+        cache_directory = ScopeBase::cache_directory();
+    } catch (exception &e) {
+        cerr << "No cache directory: " << e.what() << endl;
+    }
+
+    client_ = make_shared<Client>(oa_client_, cache_directory);
+
+    search_budget_ = budget("SOUNDCLOUD_SCOPE_SEARCH_BUDGET", search_budget_);
+    preview_budget_ = budget("SOUNDCLOUD_SCOPE_PREVIEW_BUDGET", preview_budget_);
+    activation_budget_ = budget("SOUNDCLOUD_SCOPE_ACTIVATION_BUDGET",
+                                activation_budget_);
+    home_genres_ = names("SOUNDCLOUD_SCOPE_HOME_GENRES", home_genres_);
+
+    snapshot_ = make_shared<Snapshot>(
+            cache_directory.empty() ? string() : cache_directory + "/surfacing",
+            invalidate_results);
+
+    preview_cache_ = make_shared<PreviewCache>(PREVIEW_CACHE_TRACKS,
+                                               PREVIEW_CACHE_MAX_AGE);
+    prefetcher_ = make_shared<Prefetcher>(preview_cache_, PREFETCH_BUDGET);
+
+    warm_delay_ = budget("SOUNDCLOUD_SCOPE_WARM_DELAY", warm_delay_);
+    warm_interval_ = budget("SOUNDCLOUD_SCOPE_WARM_INTERVAL", warm_interval_);
+    warmer_ = make_shared<Warmer>(*client_, home_genres_,
+            cache_directory.empty() ? string() : cache_directory + "/departments",
+            WARM_CONCURRENCY, warm_delay_, warm_interval_, WARM_JITTER,
+            WARM_BUDGET);
 }
 
 void Scope::stop() {
+    // Before the client, whose sessions it may still be using
+    if (warmer_) {
+        warmer_->stop();
+        warmer_.reset();
+    }
+    if (prefetcher_) {
+        prefetcher_->stop();
+        prefetcher_.reset();
+    }
+    client_.reset();
 }
 
 sc::SearchQueryBase::UPtr Scope::search(const sc::CannedQuery &query,
                                         const sc::SearchMetadata &metadata) {
-    return sc::SearchQueryBase::UPtr(new Query(query, metadata, oa_client_));
+    if (query.query_string().empty()
+            && !boost::algorithm::starts_with(query.department_id(), "userid:")) {
+        warmer_->used(query.department_id());
+    }
+    return sc::SearchQueryBase::UPtr(new Query(query, metadata, *client_,
+                                               search_budget_, home_genres_,
+                                               warmer_->busy(), snapshot_,
+                                               prefetcher_));
 }
 
 sc::PreviewQueryBase::UPtr Scope::preview(sc::Result const& result,
                                           sc::ActionMetadata const& metadata) {
-    return sc::PreviewQueryBase::UPtr(new Preview(result, metadata, oa_client_));
+    return sc::PreviewQueryBase::UPtr(new Preview(result, metadata, *client_,
+                                                  preview_budget_,
+                                                  warmer_->busy(),
+                                                  preview_cache_));
 }
 
 sc::ActivationQueryBase::UPtr Scope::perform_action(const sc::Result &result,
                                                  const sc::ActionMetadata &metadata,
                                                  const std::string &widget_id,
                                                  const std::string &action_id) {
-    return sc::ActivationQueryBase::UPtr(new Activation(result, metadata, action_id, oa_client_));
+    return sc::ActivationQueryBase::UPtr(new Activation(result, metadata, action_id,
+                                                        *client_, activation_budget_,
+                                                        warmer_->busy(),
+                                                        preview_cache_));
 }
 
 #define EXPORT __attribute__ ((visibility ("default")))
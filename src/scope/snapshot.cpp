@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <scope/snapshot.h>
+
+#include <boost/crc.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+using namespace scope;
+using namespace std;
+
+namespace {
+
+static const string MAGIC = "soundcloud-snapshot 1";
+
+static uint32_t checksum(const string &data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+/**
+ * Fields are written with their length in front, so they can hold anything
+ */
+static void write_field(ostream &out, const string &field) {
+    out << field.size() << ':' << field;
+}
+
+static bool read_field(istream &in, string &field) {
+    size_t size = 0;
+    if (!(in >> size) || in.get() != ':') {
+        return false;
+    }
+    field.resize(size);
+    return bool(in.read(&field[0], size));
+}
+
+static bool same_keys(const vector<Snapshot::Item> &a,
+                      const vector<Snapshot::Item> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].category != b[i].category || a[i].key != b[i].key) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+Snapshot::Snapshot(const string &file, const function<void()> &changed) :
+        file_(file), changed_(changed) {
+    load();
+}
+
+bool Snapshot::get(const string &owner, vector<Item> &items) const {
+    lock_guard<mutex> lock(mutex_);
+    if (!known_ || owner != owner_) {
+        return false;
+    }
+    items = items_;
+    return true;
+}
+
+bool Snapshot::put(const string &owner, const vector<Item> &items,
+                   bool shown) {
+    bool changed;
+    {
+        lock_guard<mutex> lock(mutex_);
+        changed = shown && known_ && owner == owner_
+                && !same_keys(items_, items);
+        known_ = true;
+        owner_ = owner;
+        items_ = items;
+        save();
+    }
+    if (changed && changed_) {
+        changed_();
+    }
+    return changed;
+}
+
+void Snapshot::load() {
+    if (file_.empty()) {
+        return;
+    }
+    ifstream in(file_, ios::binary);
+    if (!in) {
+        return;
+    }
+    string magic, header;
+    getline(in, magic);
+    getline(in, header);
+    size_t size = 0;
+    uint32_t crc = 0;
+    istringstream fields(header);
+    fields >> size >> crc;
+    string body((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (magic != MAGIC || !fields || body.size() != size
+            || checksum(body) != crc) {
+        cerr << "Dropping corrupt snapshot " << file_ << endl;
+        ::remove(file_.c_str());
+        return;
+    }
+
+    istringstream data(body);
+    string owner, count;
+    vector<Item> items;
+    bool ok = read_field(data, owner) && read_field(data, count);
+    for (size_t i = 0, n = ok ? stoul(count) : 0; ok && i < n; ++i) {
+        Item item;
+        ok = read_field(data, item.category) && read_field(data, item.key)
+                && read_field(data, item.result);
+        items.emplace_back(item);
+    }
+    if (!ok) {
+        cerr << "Dropping corrupt snapshot " << file_ << endl;
+        ::remove(file_.c_str());
+        return;
+    }
+    known_ = true;
+    owner_ = owner;
+    items_ = move(items);
+}
+
+void Snapshot::save() const {
+    if (file_.empty()) {
+        return;
+    }
+    ostringstream data;
+    write_field(data, owner_);
+    write_field(data, to_string(items_.size()));
+    for (const auto &item : items_) {
+        write_field(data, item.category);
+        write_field(data, item.key);
+        write_field(data, item.result);
+    }
+    string body = data.str();
+
+    string temp_file = file_ + ".tmp";
+    {
+        ofstream out(temp_file, ios::binary | ios::trunc);
+        out << MAGIC << '\n' << body.size() << ' ' << checksum(body) << '\n'
+                << body;
+        if (!out) {
+            cerr << "Could not store snapshot " << file_ << endl;
+            ::remove(temp_file.c_str());
+            return;
+        }
+    }
+    rename(temp_file.c_str(), file_.c_str());
+}
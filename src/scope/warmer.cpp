@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <scope/query.h>
+#include <scope/warmer.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace api;
+using namespace scope;
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/**
+ * Departments warmed each round besides the home page
+ */
+static const size_t MOST_USED = 3;
+
+}
+
+Warmer::Warmer(const Client &client, const vector<string> &home_genres,
+               const string &usage_file, unsigned int concurrency,
+               const milliseconds &delay, const milliseconds &interval,
+               const milliseconds &jitter, const milliseconds &budget) :
+        client_(client), home_genres_(home_genres), usage_file_(usage_file),
+        concurrency_(max(concurrency, 1u)), delay_(delay),
+        interval_(interval), jitter_(jitter), budget_(budget),
+        random_(random_device()()) {
+    load();
+    thread_ = thread(&Warmer::run, this);
+}
+
+Warmer::~Warmer() {
+    stop();
+}
+
+void Warmer::used(const string &department_id) {
+    lock_guard<mutex> lock(mutex_);
+    ++uses_[department_id];
+}
+
+shared_ptr<void> Warmer::busy() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        ++busy_;
+    }
+    Ptr self = shared_from_this();
+    return shared_ptr<void>(nullptr, [self](void *) {
+        {
+            lock_guard<mutex> lock(self->mutex_);
+            --self->busy_;
+        }
+        self->idle_.notify_all();
+    });
+}
+
+void Warmer::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+        for (auto &session : sessions_) {
+            session.cancel();
+        }
+    }
+    idle_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    save();
+}
+
+void Warmer::run() {
+    unique_lock<mutex> lock(mutex_);
+    steady_clock::time_point next = steady_clock::now() + delay_ + jitter();
+    while (!stopping_) {
+        if (busy_ > 0) {
+            idle_.wait(lock);
+            continue;
+        }
+        if (steady_clock::now() < next) {
+            idle_.wait_until(lock, next);
+            continue;
+        }
+
+        vector<string> departments = plan();
+        lock.unlock();
+        warm(departments);
+        lock.lock();
+
+        next = steady_clock::now() + interval_ + jitter();
+    }
+}
+
+vector<string> Warmer::plan() const {
+    vector<pair<unsigned int, string>> used;
+    for (const auto &use : uses_) {
+        if (!use.first.empty()) {
+            used.emplace_back(use.second, use.first);
+        }
+    }
+    size_t count = min(MOST_USED, used.size());
+    partial_sort(used.begin(), used.begin() + count, used.end(),
+                 [](const pair<unsigned int, string> &a,
+                    const pair<unsigned int, string> &b) {
+                     return a.first > b.first;
+                 });
+
+    // The home page is where the scope opens
+    vector<string> departments { string() };
+    for (size_t i = 0; i < count; ++i) {
+        departments.emplace_back(used[i].second);
+    }
+    return departments;
+}
+
+void Warmer::warm(const vector<string> &departments) {
+    size_t next = 0;
+    auto work = [this, &departments, &next] {
+        while (true) {
+            Client session = client_.session();
+            string department_id;
+            list<Client>::iterator running;
+            {
+                unique_lock<mutex> lock(mutex_);
+                idle_.wait(lock, [this] {
+                    return stopping_ || busy_ == 0;
+                });
+                if (stopping_ || next == departments.size()) {
+                    return;
+                }
+                department_id = departments[next++];
+                session.set_deadline(steady_clock::now() + budget_);
+                running = sessions_.insert(sessions_.end(), session);
+            }
+
+            try {
+                Query::warm(session, department_id, home_genres_);
+            } catch (exception &e) {
+                cerr << "Could not warm department '" << department_id
+                     << "': " << e.what() << endl;
+            }
+
+            unique_lock<mutex> lock(mutex_);
+            sessions_.erase(running);
+            // Spread the requests out a little
+            idle_.wait_for(lock, jitter(), [this] {
+                return stopping_;
+            });
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t i = 1; i < min<size_t>(concurrency_, departments.size()); ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+milliseconds Warmer::jitter() {
+    if (jitter_.count() <= 0) {
+        return milliseconds(0);
+    }
+    uniform_int_distribution<milliseconds::rep> share(0, jitter_.count());
+    return milliseconds(share(random_));
+}
+
+void Warmer::load() {
+    if (usage_file_.empty()) {
+        return;
+    }
+    ifstream in(usage_file_);
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        unsigned int uses = 0;
+        string department_id;
+        if (fields >> uses && fields.get() == '\t'
+                && getline(fields, department_id)) {
+            uses_[department_id] = uses;
+        }
+    }
+}
+
+void Warmer::save() const {
+    if (usage_file_.empty()) {
+        return;
+    }
+    lock_guard<mutex> lock(mutex_);
+    string temp_file = usage_file_ + ".tmp";
+    {
+        ofstream out(temp_file, ios::trunc);
+        for (const auto &use : uses_) {
+            out << use.second << '\t' << use.first << '\n';
+        }
+        if (!out) {
+            cerr << "Could not store department uses in " << usage_file_
+                 << endl;
+            ::remove(temp_file.c_str());
+            return;
+        }
+    }
+    rename(temp_file.c_str(), usage_file_.c_str());
+}
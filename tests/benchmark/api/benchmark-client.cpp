@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/client.h>
+
+#include <core/posix/exec.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace posix = core::posix;
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/**
+ * Every request starts by taking the configuration snapshot (API root,
+ * credentials and user agent), then registers with its session and the
+ * in-flight table before it goes out. Measure how fast concurrent
+ * issuers get their requests out as their number grows, and how long
+ * the fake server takes to answer them all.
+ *
+ * Each request asks for a different limit, so that none of them is
+ * answered from the result cache or joins another one in flight.
+ */
+void benchmark_request_issue(api::Client &client) {
+    const unsigned int requests = 100;
+
+    cout << "request issue (" << requests << " per thread)" << endl;
+    cout << setw(8) << "threads" << setw(16) << "issued/s"
+            << setw(16) << "answered/s" << setw(8) << "failed" << endl;
+
+    unsigned int round = 0;
+    for (unsigned int threads = 1; threads <= 16; threads *= 2, ++round) {
+        vector<vector<future<deque<api::Track>>>> issued(threads);
+        vector<thread> workers;
+        auto start = steady_clock::now();
+        for (unsigned int i = 0; i < threads; ++i) {
+            unsigned int first = (round * 16 + i) * requests;
+            workers.emplace_back([&client, &issued, i, first, requests]() {
+                api::Client session = client.session();
+                for (unsigned int j = 0; j < requests; ++j) {
+                    issued[i].emplace_back(session.search_tracks({
+                        { api::SP::query, "hermitude" },
+                        { api::SP::limit, to_string(first + j + 1) }
+                    }));
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        duration<double> issuing = steady_clock::now() - start;
+
+        unsigned int failed = 0;
+        for (auto &futures : issued) {
+            for (auto &tracks : futures) {
+                try {
+                    tracks.get();
+                } catch (exception &) {
+                    ++failed;
+                }
+            }
+        }
+        duration<double> answering = steady_clock::now() - start;
+
+        double total = double(threads) * requests;
+        cout << setw(8) << threads << setw(16) << fixed << setprecision(0)
+                << total / issuing.count() << setw(16)
+                << total / answering.count() << setw(8) << failed << endl;
+    }
+}
+
+}
+
+int main() {
+    // Start up the Python-based fake SoundCloud server, and talk to it
+    posix::ChildProcess server = posix::exec("/usr/bin/python3",
+            { FAKE_SERVER }, { }, posix::StandardStream::stdout);
+    string port;
+    server.cout() >> port;
+    if (port.empty()) {
+        cerr << "fake server did not start" << endl;
+        return 1;
+    }
+    string apiroot = "http://127.0.0.1:" + port;
+    setenv("NETWORK_SCOPE_APIROOT", apiroot.c_str(), true);
+
+    // Keep the online accounts service out of the measurement
+    setenv("SOUNDCLOUD_SCOPE_IGNORE_ACCOUNTS", "true", true);
+
+    api::Client client { shared_ptr<unity::scopes::OnlineAccountClient>() };
+    benchmark_request_issue(client);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <api/decoder.h>
+#include <api/json_stream.h>
+#include <api/track.h>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <json/json.h>
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace io = boost::iostreams;
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+string read_fixture(const string &name) {
+    ifstream in(string(FAKE_SERVER_FIXTURES) + "/" + name);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+string gzip(const string &text) {
+    string compressed;
+    io::filtering_ostream os;
+    os.push(io::gzip_compressor());
+    os.push(io::back_inserter(compressed));
+    os << text;
+    io::close(os);
+    return compressed;
+}
+
+/**
+ * Copy each item out of the DOM and look up every field by name, like
+ * the client used to
+ */
+deque<api::Track> tracks_from_dom(const Json::Value &root) {
+    deque<api::Track> results;
+    for (Json::ArrayIndex index = 0; index < root.size(); ++index) {
+        Json::Value item = root[index];
+        if (item["kind"].asString() == "track") {
+            results.emplace_back(api::Track(item));
+        }
+    }
+    return results;
+}
+
+/**
+ * Inflate into a string, parse it all with Json::Reader, then convert
+ */
+deque<api::Track> decode_reader(const string &body) {
+    string decompressed;
+    io::filtering_ostream os;
+    os.push(io::gzip_decompressor());
+    os.push(io::back_inserter(decompressed));
+    os << body;
+    io::close(os);
+
+    Json::Value root;
+    Json::Reader reader;
+    reader.parse(decompressed, root);
+    return tracks_from_dom(root);
+}
+
+/**
+ * Inflate and parse incrementally, but still through the DOM
+ */
+deque<api::Track> decode_stream_dom(const string &body) {
+    api::JsonValueBuilder builder;
+    api::GzipJsonStream stream(builder);
+    stream.write(body);
+    stream.close();
+    return tracks_from_dom(builder.root());
+}
+
+/**
+ * Inflate and decode straight into the tracks
+ */
+deque<api::Track> decode_direct(const string &body) {
+    api::ListDecoder<api::Track> decoder("track");
+    api::GzipJsonStream stream(decoder);
+    stream.write(body);
+    stream.close();
+    return decoder.result();
+}
+
+void benchmark_decoders(const string &fixture) {
+    const unsigned int iterations = 500;
+
+    string text = read_fixture(fixture);
+    string body = gzip(text);
+
+    cout << fixture << " (" << text.size() << " bytes, " << body.size()
+            << " gzipped)" << endl;
+    cout << setw(20) << "decoder" << setw(14) << "us/document" << setw(10)
+            << "tracks" << endl;
+
+    const pair<const char *, function<deque<api::Track>(const string&)>> decoders[] {
+        { "reader + dom", decode_reader },
+        { "stream + dom", decode_stream_dom },
+        { "stream + schema", decode_direct }
+    };
+    for (const auto &decoder : decoders) {
+        size_t tracks = 0;
+        auto start = steady_clock::now();
+        for (unsigned int i = 0; i < iterations; ++i) {
+            tracks += decoder.second(body).size();
+        }
+        duration<double, micro> elapsed = steady_clock::now() - start;
+
+        cout << setw(20) << decoder.first << setw(14) << fixed
+                << setprecision(1) << elapsed.count() / iterations
+                << setw(10) << tracks / iterations << endl;
+    }
+    cout << endl;
+}
+
+}
+
+int main() {
+    benchmark_decoders("search/hermitude.json");
+    benchmark_decoders("genre/Hip Hop.json");
+    benchmark_decoders("genre/Popular Music.json");
+
+    return 0;
+}
@@ -1,11 +1,20 @@
 #!/usr/bin/env python3
 
+import email.utils
 import gzip
+import hashlib
 import http.server
+import json
 import os
 import sys
 import urllib.parse
 
+def modification_time(path):
+    file = os.path.join(os.path.dirname(__file__), path)
+    if os.path.isfile(file):
+        return email.utils.formatdate(os.path.getmtime(file), usegmt=True)
+    return None
+
 def read_file(path):
     file = os.path.join(os.path.dirname(__file__), path)
     if os.path.isfile(file):
@@ -17,6 +26,9 @@ def read_file(path):
 
     return content
 
+def cache_control():
+    return os.environ.get('FAKE_SERVER_CACHE_CONTROL', 'no-cache')
+
 class MyRequestHandler(http.server.BaseHTTPRequestHandler):
     def do_GET(self):
         sys.stderr.write("GET: %s\n" % self.path)
@@ -28,30 +40,141 @@ class MyRequestHandler(http.server.BaseHTTPRequestHandler):
             self.handle_track_search(query)
         elif url.path == '/me/activities/tracks/affiliated.json':
             self.handle_activity(query)
+        elif url.path == '/me/activities/all.json':
+            self.handle_newer_activity(query)
         else:
             self.send_response(404)
             self.send_header("Content-type", "text/html")
             self.end_headers()
             self.wfile.write(b'ERROR')
 
-    def handle_track_search(self, query):
+    def send_json(self, path):
+        """Send a fixture, with validators so that clients can revalidate.
+
+        The fixtures are sent with no-cache, so that every repeat request
+        is a conditional one, answered with 304 if the fixture is unchanged.
+        FAKE_SERVER_CACHE_CONTROL replaces that Cache-Control header.
+        """
+        self.send_content(read_file(path), modification_time(path))
+
+    def send_content(self, content, last_modified=None):
+        etag = '"{}"'.format(hashlib.md5(content).hexdigest())
+
+        if self.headers.get('If-None-Match') == etag or (
+                self.headers.get('If-None-Match') is None
+                and last_modified is not None
+                and self.headers.get('If-Modified-Since') == last_modified):
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Cache-Control", cache_control())
+            self.end_headers()
+            return
+
         self.send_response(200)
         self.send_header("Content-type", "application/json")
         self.send_header("Content-Encoding", "gzip")
+        self.send_header("ETag", etag)
+        if last_modified is not None:
+            self.send_header("Last-Modified", last_modified)
+        self.send_header("Cache-Control", cache_control())
         self.end_headers()
+        self.wfile.write(gzip.compress(content))
+
+    def handle_track_search(self, query):
+        if query.get('ids'):
+            self.send_tracks_by_id(query['ids'].split(','))
+            return
         if query.get('q'):
-            self.wfile.write(gzip.compress(
-                read_file('search/{}.json'.format(query['q']))))
+            path = 'search/{}.json'.format(query['q'])
+        else:
+            path = 'genre/{}.json'.format(query['genres'])
+        if query.get('linked_partitioning') or query.get('offset'):
+            self.send_page(path, query)
         else:
-            self.wfile.write(gzip.compress(
-                read_file('genre/{}.json'.format(query['genres']))))
+            self.send_json(path)
+
+    def send_tracks_by_id(self, ids):
+        """Send the fixture tracks with the given IDs, in no particular order.
+
+        Unknown IDs are left out, like deleted or private tracks are.
+        """
+        tracks = {}
+        for path in [ 'search/hermitude.json', 'genre/Hip Hop.json',
+                      'genre/Popular Music.json' ]:
+            for track in json.loads(read_file(path).decode('utf-8')):
+                tracks[str(track['id'])] = track
+        found = [ tracks[id] for id in ids if id in tracks ]
+        self.send_content(json.dumps(list(reversed(found))).encode('utf-8'))
+
+    def send_page(self, path, query):
+        """Send a slice of a list fixture.
+
+        With linked_partitioning, the slice comes with the cursor to the
+        next one. Each of those starts with the last track of the one
+        before, like the real API's pages do when the list changes while
+        it is walked.
+        """
+        tracks = json.loads(read_file(path).decode('utf-8'))
+        offset = int(query.get('offset', 0))
+        limit = int(query.get('limit', 50))
+        if not query.get('linked_partitioning'):
+            self.send_content(json.dumps(tracks[offset:offset + limit]).encode('utf-8'))
+            return
+        page = { 'collection': tracks[offset:offset + limit] }
+        if offset + limit < len(tracks):
+            next_query = dict(query)
+            next_query['offset'] = str(offset + limit - 1)
+            page['next_href'] = 'http://{}{}?{}'.format(
+                self.headers.get('Host'), urllib.parse.urlparse(self.path).path,
+                urllib.parse.urlencode(next_query))
+        self.send_content(json.dumps(page).encode('utf-8'))
+
+    # Full activity fetches so far, when cursors are made to expire
+    activity_fetches = 0
 
     def handle_activity(self, query):
-        self.send_response(200)
-        self.send_header("Content-type", "application/json")
-        self.send_header("Content-Encoding", "gzip")
-        self.end_headers()
-        self.wfile.write(gzip.compress(read_file('activity/tracks.json')))
+        """Send the activity fixture.
+
+        With FAKE_SERVER_EXPIRED_CURSORS set, its future_href is replaced
+        by a cursor that has already expired, and one track is posted
+        between each full fetch and the next.
+        """
+        if not os.environ.get('FAKE_SERVER_EXPIRED_CURSORS'):
+            self.send_json('activity/tracks.json')
+            return
+        page = json.loads(read_file('activity/tracks.json').decode('utf-8'))
+        page['future_href'] = 'http://{}/me/activities/all.json?{}'.format(
+            self.headers.get('Host'),
+            urllib.parse.urlencode({ 'uuid[to]': 'expired', 'limit': 30 }))
+        if MyRequestHandler.activity_fetches > 0:
+            track = json.loads(read_file('genre/Hip Hop.json').decode('utf-8'))[0]
+            page['collection'].insert(0, { 'type': 'track', 'origin': track })
+        MyRequestHandler.activity_fetches += 1
+        self.send_content(json.dumps(page).encode('utf-8'))
+
+    def handle_newer_activity(self, query):
+        """Follow the future_href of the activity fixture.
+
+        Since the fixture, one track was posted. There is nothing newer
+        than that, and any other cursor has expired.
+        """
+        cursor = query.get('uuid[to]')
+        newest = 'http://{}/me/activities/all.json?{}'.format(
+            self.headers.get('Host'),
+            urllib.parse.urlencode({ 'uuid[to]': 'newest', 'limit': 30 }))
+        if cursor == '41d51853-3700-0000-63f9-9c1ab9cad052':
+            track = json.loads(read_file('genre/Hip Hop.json').decode('utf-8'))[0]
+            page = { 'collection': [ { 'type': 'track', 'origin': track } ],
+                     'future_href': newest }
+        elif cursor == 'newest':
+            page = { 'collection': [], 'future_href': newest }
+        else:
+            self.send_response(400)
+            self.send_header("Content-type", "application/json")
+            self.end_headers()
+            self.wfile.write(b'{"errors":[{"error_message":"expired"}]}')
+            return
+        self.send_content(json.dumps(page).encode('utf-8'))
 
 def main(argv):
     server = http.server.HTTPServer(("127.0.0.1", 0), MyRequestHandler)
@@ -0,0 +1,338 @@
+
+#include <api/client.h>
+#include <api/hotness.h>
+
+#include <core/posix/exec.h>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+namespace posix = core::posix;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+class TestClient: public Test {
+protected:
+    void SetUp() override
+    {
+        start_server({ });
+
+        setenv("SOUNDCLOUD_SCOPE_IGNORE_ACCOUNTS", "true", true);
+
+        // Every test gets an empty cache directory
+        char cache_template[] = "/tmp/soundcloud-test-XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(cache_template));
+        cache_directory_ = cache_template;
+    }
+
+    void TearDown() override
+    {
+        system(("rm -rf '" + cache_directory_ + "'").c_str());
+    }
+
+    /**
+     * (Re)start the fake server with @a environment, and point the client
+     * at it
+     */
+    void start_server(const map<string, string> &environment)
+    {
+        // Start up Python-based fake SoundCloud server
+        fake_server_ = posix::exec("/usr/bin/python3", { FAKE_SERVER },
+                                   environment, posix::StandardStream::stdout);
+
+        // Check it's running
+        ASSERT_GT(fake_server_.pid(), 0);
+        string port;
+        // The server will print out the random port it is using
+        fake_server_.cout() >> port;
+        // Check we have a port
+        ASSERT_FALSE(port.empty());
+
+        // Build up the API root
+        string apiroot = "http://127.0.0.1:" + port;
+        // Override the API root that the client will use
+        setenv("NETWORK_SCOPE_APIROOT", apiroot.c_str(), true);
+    }
+
+    /**
+     * Start by assuming the server is invalid
+     */
+    posix::ChildProcess fake_server_ = posix::ChildProcess::invalid();
+
+    string cache_directory_;
+};
+
+TEST_F(TestClient, revalidates_stale_responses) {
+    Client client(nullptr, cache_directory_);
+
+    deque<pair<SP, string>> parameters {
+        { SP::genre, "Hip Hop" },
+        { SP::limit, "15" }
+    };
+
+    // The fake server has everything revalidated on every use
+    Client first = client.session();
+    deque<Track> tracks = first.search_tracks(parameters).get();
+    ASSERT_FALSE(tracks.empty());
+    EXPECT_EQ(0u, first.statistics().revalidated);
+
+    // So the second request is a conditional one, answered with a 304
+    Client second = client.session();
+    deque<Track> revalidated = second.search_tracks(parameters).get();
+    EXPECT_EQ(1u, second.statistics().revalidated);
+
+    ASSERT_EQ(tracks.size(), revalidated.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        EXPECT_EQ(tracks[i].id(), revalidated[i].id());
+        EXPECT_EQ(tracks[i].title(), revalidated[i].title());
+    }
+}
+
+TEST_F(TestClient, serves_fresh_responses_without_asking) {
+    // A max-age shorter than our own TTL is not taken up
+    start_server({ { "FAKE_SERVER_CACHE_CONTROL", "max-age=0" } });
+    Client client(nullptr, cache_directory_);
+
+    deque<pair<SP, string>> parameters {
+        { SP::genre, "Hip Hop" },
+        { SP::limit, "15" }
+    };
+
+    Client first = client.session();
+    deque<Track> tracks = first.search_tracks(parameters).get();
+    ASSERT_FALSE(tracks.empty());
+    EXPECT_EQ(0u, first.statistics().result_cache_hits);
+
+    Client second = client.session();
+    deque<Track> cached = second.search_tracks(parameters).get();
+    EXPECT_EQ(1u, second.statistics().result_cache_hits);
+    EXPECT_EQ(0u, second.statistics().revalidated);
+
+    ASSERT_EQ(tracks.size(), cached.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        EXPECT_EQ(tracks[i].id(), cached[i].id());
+    }
+}
+
+TEST_F(TestClient, does_not_keep_no_store_responses) {
+    start_server({ { "FAKE_SERVER_CACHE_CONTROL", "no-store" } });
+    Client client(nullptr, cache_directory_);
+
+    deque<pair<SP, string>> parameters {
+        { SP::genre, "Hip Hop" },
+        { SP::limit, "15" }
+    };
+
+    ASSERT_FALSE(client.session().search_tracks(parameters).get().empty());
+
+    // Fetched in full again, without a conditional request
+    Client second = client.session();
+    ASSERT_FALSE(second.search_tracks(parameters).get().empty());
+    EXPECT_EQ(0u, second.statistics().result_cache_hits);
+    EXPECT_EQ(0u, second.statistics().revalidated);
+}
+
+TEST_F(TestClient, offers_tracks_through_channel) {
+    Client client(nullptr, cache_directory_);
+
+    auto channel = make_shared<Channel<Track>>();
+    future<deque<Track>> tracks_future = client.search_tracks({
+        { SP::query, "hermitude" }
+    }, channel);
+    deque<Track> tracks = tracks_future.get();
+    ASSERT_FALSE(tracks.empty());
+
+    // Everything was offered in list order, then the channel was closed
+    deque<Track> offered = channel->take(chrono::seconds(0));
+    EXPECT_TRUE(channel->closed());
+    ASSERT_EQ(tracks.size(), offered.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        EXPECT_EQ(tracks[i].id(), offered[i].id());
+    }
+}
+
+TEST_F(TestClient, gives_up_at_the_deadline) {
+    Client client(nullptr, cache_directory_);
+
+    deque<pair<SP, string>> parameters {
+        { SP::query, "hermitude" }
+    };
+
+    // Nothing on the network once the session is out of time
+    Client late = client.session();
+    late.set_deadline(chrono::steady_clock::now());
+    EXPECT_THROW(late.search_tracks(parameters).get(), domain_error);
+
+    // Other sessions are not affected
+    Client session = client.session();
+    deque<Track> tracks = session.search_tracks(parameters).get();
+    ASSERT_FALSE(tracks.empty());
+
+    // What is cached can still be served
+    deque<Track> cached = late.search_tracks(parameters).get();
+    EXPECT_EQ(tracks.size(), cached.size());
+}
+
+TEST_F(TestClient, cancels_one_session_at_a_time) {
+    Client client(nullptr, cache_directory_);
+
+    deque<pair<SP, string>> parameters {
+        { SP::genre, "Hip Hop" }
+    };
+
+    // Both share the same transfer
+    Client cancelled = client.session();
+    Client other = client.session();
+    future<deque<Track>> cancelled_future = cancelled.search_tracks(parameters);
+    future<deque<Track>> other_future = other.search_tracks(parameters);
+    EXPECT_EQ(1u, other.statistics().coalesced);
+
+    // The cancelled one gives up straight away, the other one carries on
+    cancelled.cancel();
+    ASSERT_EQ(future_status::ready, cancelled_future.wait_for(chrono::seconds(0)));
+    EXPECT_THROW(cancelled_future.get(), domain_error);
+    EXPECT_FALSE(other_future.get().empty());
+
+    // Nothing new goes out for it either
+    EXPECT_THROW(cancelled.search_tracks({ { SP::query, "hermitude" } }).get(),
+                 domain_error);
+}
+
+TEST_F(TestClient, walks_pages_without_repeating_tracks) {
+    Client client(nullptr, cache_directory_);
+
+    deque<Track> expected = client.search_tracks({
+        { SP::query, "hermitude" }
+    }).get();
+    ASSERT_EQ(30u, expected.size());
+
+    // The fake server's pages overlap by one track
+    Client::TrackPager::Ptr pager = client.search_track_pages({
+        { SP::query, "hermitude" },
+        { SP::limit, "10" }
+    });
+    deque<Track> walked;
+    unsigned int pages = 0;
+    while (!pager->exhausted()) {
+        deque<Track> page = pager->next().get();
+        walked.insert(walked.end(), page.begin(), page.end());
+        ASSERT_LT(++pages, 10u);
+    }
+    EXPECT_EQ(4u, pages);
+
+    ASSERT_EQ(expected.size(), walked.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].id(), walked[i].id());
+    }
+    EXPECT_TRUE(pager->next().get().empty());
+}
+
+TEST_F(TestClient, merges_newer_activities_into_the_stream) {
+    Client client(nullptr, cache_directory_);
+
+    deque<Track> first = client.stream_tracks(30).get();
+    ASSERT_EQ(15u, first.size());
+
+    // Only the one track posted since is fetched, and goes in front
+    deque<Track> second = client.stream_tracks(30).get();
+    ASSERT_EQ(16u, second.size());
+    EXPECT_EQ(176845521u, second[0].id());
+    for (size_t i = 0; i < first.size(); ++i) {
+        EXPECT_EQ(first[i].id(), second[i + 1].id());
+    }
+
+    // Nothing new since then
+    deque<Track> third = client.stream_tracks(30).get();
+    ASSERT_EQ(second.size(), third.size());
+    EXPECT_EQ(second[0].id(), third[0].id());
+
+    // A shorter list comes from the same copy
+    deque<Track> shorter = client.stream_tracks(5).get();
+    ASSERT_EQ(5u, shorter.size());
+    EXPECT_EQ(second[0].id(), shorter[0].id());
+}
+
+TEST_F(TestClient, fetches_the_stream_again_once_its_cursor_expired) {
+    // Every cursor the server hands out is refused
+    start_server({ { "FAKE_SERVER_EXPIRED_CURSORS", "1" } });
+    Client client(nullptr, cache_directory_);
+
+    deque<Track> first = client.stream_tracks(30).get();
+    ASSERT_EQ(15u, first.size());
+
+    // The refusal of the cursor is followed by a full fetch, which has
+    // the track posted since
+    deque<Track> second = client.stream_tracks(30).get();
+    ASSERT_EQ(16u, second.size());
+    EXPECT_EQ(176845521u, second[0].id());
+    for (size_t i = 0; i < first.size(); ++i) {
+        EXPECT_EQ(first[i].id(), second[i + 1].id());
+    }
+}
+
+TEST_F(TestClient, looks_up_tracks_by_id) {
+    Client client(nullptr, cache_directory_);
+
+    // More than fit in one request, with an unknown one in between
+    deque<Track> known;
+    for (const auto &parameter : { make_pair(SP::query, "hermitude"),
+            make_pair(SP::genre, "Hip Hop"),
+            make_pair(SP::genre, "Popular Music") }) {
+        deque<Track> tracks = client.search_tracks({ parameter }).get();
+        known.insert(known.end(), tracks.begin(), tracks.end());
+    }
+    ASSERT_EQ(60u, known.size());
+
+    vector<unsigned int> ids;
+    for (const auto &track : known) {
+        ids.emplace_back(track.id());
+    }
+    ids.insert(ids.begin() + 20, 1);
+    ids.emplace_back(known[0].id());
+
+    Client::TrackLookup lookup = client.get_tracks(ids).get();
+    EXPECT_EQ(vector<unsigned int> { 1 }, lookup.missing);
+
+    // In the order asked for, repeats included
+    known.emplace_back(known[0]);
+    ASSERT_EQ(known.size(), lookup.tracks.size());
+    for (size_t i = 0; i < known.size(); ++i) {
+        EXPECT_EQ(known[i].id(), lookup.tracks[i].id());
+        EXPECT_EQ(known[i].title(), lookup.tracks[i].title());
+    }
+
+    EXPECT_TRUE(client.get_tracks({ }).get().tracks.empty());
+}
+
+TEST_F(TestClient, ranks_hot_tracks_from_the_pool) {
+    Client client(nullptr, cache_directory_);
+
+    // The fixture holds the whole pool
+    deque<Track> genre = client.search_tracks({
+        { SP::genre, "Hip Hop" }
+    }).get();
+    deque<Track> expected = hottest(genre, 10, chrono::system_clock::now());
+
+    deque<Track> hot = client.hot_tracks("Hip Hop", 10).get();
+    ASSERT_EQ(10u, hot.size());
+    for (size_t i = 0; i < hot.size(); ++i) {
+        EXPECT_EQ(expected[i].id(), hot[i].id());
+    }
+
+    // The pool answers the next caller straight away
+    future<deque<Track>> again = client.hot_tracks("Hip Hop", 3);
+    ASSERT_EQ(future_status::ready, again.wait_for(chrono::seconds(0)));
+    EXPECT_EQ(3u, again.get().size());
+}
+
+} // namespace
@@ -0,0 +1,174 @@
+
+#include <api/decoder.h>
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+static string read_fixture(const string &name) {
+    ifstream in(string(FAKE_SERVER_FIXTURES) + "/" + name);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+template<typename T>
+static T decode(Decoder<T> &decoder, const string &text) {
+    JsonStreamParser parser(decoder);
+    parser.feed(text.data(), text.size());
+    parser.finish();
+    return decoder.result();
+}
+
+static void expect_same_user(const User &expected, const User &actual) {
+    EXPECT_EQ(expected.id(), actual.id());
+    EXPECT_EQ(expected.title(), actual.title());
+    EXPECT_EQ(expected.artwork(), actual.artwork());
+    EXPECT_EQ(expected.permalink_url(), actual.permalink_url());
+    EXPECT_EQ(expected.track_count(), actual.track_count());
+    EXPECT_EQ(expected.followers_count(), actual.followers_count());
+    EXPECT_EQ(expected.followings_count(), actual.followings_count());
+    EXPECT_EQ(expected.bio(), actual.bio());
+}
+
+static void expect_same_track(const Track &expected, const Track &actual) {
+    EXPECT_EQ(expected.id(), actual.id());
+    EXPECT_EQ(expected.title(), actual.title());
+    EXPECT_EQ(expected.description(), actual.description());
+    EXPECT_EQ(expected.artwork(), actual.artwork());
+    EXPECT_EQ(expected.waveform(), actual.waveform());
+    EXPECT_EQ(expected.label_name(), actual.label_name());
+    EXPECT_EQ(expected.duration(), actual.duration());
+    EXPECT_EQ(expected.license(), actual.license());
+    EXPECT_EQ(expected.created_at(), actual.created_at());
+    EXPECT_EQ(expected.streamable(), actual.streamable());
+    EXPECT_EQ(expected.downloadable(), actual.downloadable());
+    EXPECT_EQ(expected.permalink_url(), actual.permalink_url());
+    EXPECT_EQ(expected.purchase_url(), actual.purchase_url());
+    EXPECT_EQ(expected.stream_url(), actual.stream_url());
+    EXPECT_EQ(expected.download_url(), actual.download_url());
+    EXPECT_EQ(expected.video_url(), actual.video_url());
+    EXPECT_EQ(expected.playback_count(), actual.playback_count());
+    EXPECT_EQ(expected.favoritings_count(), actual.favoritings_count());
+    EXPECT_EQ(expected.comment_count(), actual.comment_count());
+    EXPECT_EQ(expected.repost_count(), actual.repost_count());
+    EXPECT_EQ(expected.likes_count(), actual.likes_count());
+    EXPECT_EQ(expected.genre(), actual.genre());
+    EXPECT_EQ(expected.original_format(), actual.original_format());
+    expect_same_user(expected.user(), actual.user());
+}
+
+TEST(TestDecoder, decodes_track_lists_like_the_dom) {
+    for (const char *fixture : { "search/hermitude.json", "genre/Hip Hop.json",
+            "genre/Popular Music.json" }) {
+        string text = read_fixture(fixture);
+        ASSERT_FALSE(text.empty()) << fixture;
+
+        Json::Value root;
+        Json::Reader reader;
+        ASSERT_TRUE(reader.parse(text, root));
+
+        ListDecoder<Track> decoder("track");
+        deque<Track> tracks = decode<deque<Track>>(decoder, text);
+
+        ASSERT_EQ(root.size(), tracks.size()) << fixture;
+        for (Json::ArrayIndex i = 0; i < root.size(); ++i) {
+            expect_same_track(Track(root[i]), tracks[i]);
+        }
+    }
+}
+
+TEST(TestDecoder, decodes_activities) {
+    string text = read_fixture("activity/tracks.json");
+    Json::Value root;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(text, root));
+
+    ActivityListDecoder<Track> decoder("track");
+    deque<Track> tracks = decode<deque<Track>>(decoder, text);
+
+    const Json::Value &collection = root["collection"];
+    deque<Track> expected;
+    for (Json::ArrayIndex i = 0; i < collection.size(); ++i) {
+        if (collection[i]["type"].asString() == "track") {
+            expected.emplace_back(Track(collection[i]["origin"]));
+        }
+    }
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(expected.size(), tracks.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expect_same_track(expected[i], tracks[i]);
+    }
+}
+
+TEST(TestDecoder, filters_by_kind_and_skips_unknown_fields) {
+    string text = R"([
+        { "kind": "comment", "id": 1, "body": "first",
+          "created_at": "2014/11/14 06:27:25 +0000",
+          "extra": { "nested": [ 1, { "id": 7 } ] },
+          "user": { "id": 5, "username": "someone", "tags": [ "x" ] } },
+        { "kind": "track", "id": 2 },
+        { "id": 3, "kind": "comment", "body": null, "user": null }
+    ])";
+
+    ListDecoder<Comment> decoder("comment");
+    deque<Comment> comments = decode<deque<Comment>>(decoder, text);
+
+    ASSERT_EQ(2u, comments.size());
+    EXPECT_EQ(1u, comments[0].id());
+    EXPECT_EQ("first", comments[0].body());
+    EXPECT_EQ("2014/11/14", comments[0].created_at());
+    EXPECT_EQ(5u, comments[0].user().id());
+    EXPECT_EQ("someone", comments[0].user().title());
+    EXPECT_EQ(3u, comments[1].id());
+    EXPECT_EQ("", comments[1].body());
+    EXPECT_EQ(0u, comments[1].user().id());
+}
+
+TEST(TestDecoder, decodes_pages_and_their_cursors) {
+    PageDecoder<Track> decoder(make_shared<ListDecoder<Track>>("track"));
+    Page<Track> page = decode<Page<Track>>(decoder, R"({
+        "collection": [
+            { "kind": "track", "id": 1, "next_href": "not this one" },
+            { "kind": "user", "id": 2 },
+            { "kind": "track", "id": 3 }
+        ],
+        "next_href": "https://api.soundcloud.com/tracks?offset=2"
+    })");
+    ASSERT_EQ(2u, page.items.size());
+    EXPECT_EQ(1u, page.items[0].id());
+    EXPECT_EQ(3u, page.items[1].id());
+    EXPECT_EQ("https://api.soundcloud.com/tracks?offset=2", page.next_href);
+    EXPECT_EQ("", page.future_href);
+
+    string text = read_fixture("activity/tracks.json");
+    PageDecoder<Track> activities(make_shared<ActivityListDecoder<Track>>("track"));
+    Page<Track> stream = decode<Page<Track>>(activities, text);
+    EXPECT_FALSE(stream.items.empty());
+    EXPECT_NE(string::npos, stream.next_href.find("cursor="));
+    EXPECT_NE(string::npos, stream.future_href.find("uuid%5Bto%5D="));
+}
+
+TEST(TestDecoder, decodes_single_objects) {
+    ObjectDecoder<User> decoder("user");
+    User user = decode<User>(decoder, R"({ "kind": "user", "id": 42,
+        "username": "me", "followers_count": 12, "description": "Hi" })");
+    EXPECT_EQ(42u, user.id());
+    EXPECT_EQ("me", user.title());
+    EXPECT_EQ(12u, user.followers_count());
+    EXPECT_EQ("Hi", user.bio());
+
+    ObjectDecoder<User> other("user");
+    EXPECT_EQ(0u, decode<User>(other, R"({ "kind": "track", "id": 42 })").id());
+}
+
+} // namespace
@@ -0,0 +1,174 @@
+#include <api/disk_cache.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * The size the client gives its cache
+ */
+static const size_t CACHE_SIZE = 20 * 1024 * 1024;
+
+class TestDiskCache: public Test {
+protected:
+    void SetUp() override
+    {
+        char directory_template[] = "/tmp/soundcloud-cache-XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(directory_template));
+        directory_ = string(directory_template) + "/http";
+    }
+
+    void TearDown() override
+    {
+        system(("rm -rf '" + directory_.substr(0, directory_.rfind('/')) + "'").c_str());
+    }
+
+    static DiskCache::Entry entry(const string &body,
+                                  const chrono::seconds &ttl = chrono::hours(1)) {
+        DiskCache::Entry entry;
+        entry.body = body;
+        entry.etag = "\"etag\"";
+        entry.stored = DiskCache::Clock::now();
+        entry.expiry = entry.stored + ttl;
+        return entry;
+    }
+
+    string file(const string &key) const {
+        return directory_ + "/" + DiskCache::digest(key);
+    }
+
+    bool exists(const string &path) const {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    string directory_;
+};
+
+TEST_F(TestDiskCache, keeps_entries_across_restarts) {
+    {
+        DiskCache cache(directory_, CACHE_SIZE);
+        cache.put("a", entry("body of a"));
+    }
+
+    DiskCache cache(directory_, CACHE_SIZE);
+    DiskCache::Entry found;
+    ASSERT_TRUE(cache.get("a", found));
+    EXPECT_EQ("body of a", found.body);
+    EXPECT_EQ("\"etag\"", found.etag);
+    EXPECT_TRUE(found.fresh());
+    EXPECT_FALSE(cache.get("b", found));
+}
+
+TEST_F(TestDiskCache, drops_entries_that_fail_their_checksum) {
+    DiskCache cache(directory_, CACHE_SIZE);
+    cache.put("a", entry("body of a"));
+    ASSERT_GT(cache.size(), 0u);
+
+    // Flip the last byte of the body, leaving its length alone
+    {
+        fstream out(file("a"), ios::in | ios::out | ios::binary);
+        out.seekp(-1, ios::end);
+        out.put('b');
+    }
+
+    DiskCache::Entry found;
+    EXPECT_FALSE(cache.get("a", found));
+    EXPECT_FALSE(exists(file("a")));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(TestDiskCache, replaces_entries_atomically) {
+    DiskCache cache(directory_, CACHE_SIZE);
+    cache.put("a", entry("first body"));
+    cache.put("a", entry("second"));
+
+    DiskCache::Entry found;
+    ASSERT_TRUE(cache.get("a", found));
+    EXPECT_EQ("second", found.body);
+    EXPECT_FALSE(exists(file("a") + ".tmp"));
+
+    // Only the replacement is counted
+    struct stat st;
+    ASSERT_EQ(0, stat(file("a").c_str(), &st));
+    EXPECT_EQ(size_t(st.st_size), cache.size());
+
+    // A write that was interrupted before its rename leaves the entry
+    // before it in place, and its temporary file is cleaned up
+    {
+        ofstream out(file("a") + ".tmp", ios::binary);
+        out << "soundcloud-cache 2\na\n";
+    }
+    DiskCache reopened(directory_, CACHE_SIZE);
+    ASSERT_TRUE(reopened.get("a", found));
+    EXPECT_EQ("second", found.body);
+    EXPECT_FALSE(exists(file("a") + ".tmp"));
+}
+
+TEST_F(TestDiskCache, evicts_least_recently_used_over_the_limit) {
+    DiskCache cache(directory_, CACHE_SIZE);
+    string body(CACHE_SIZE / 4, 'x');
+    cache.put("a", entry(body));
+    cache.put("b", entry(body));
+    cache.put("c", entry(body));
+
+    // Using a makes b the oldest
+    DiskCache::Entry found;
+    ASSERT_TRUE(cache.get("a", found));
+
+    // Four quarters plus their headers do not fit
+    cache.put("d", entry(body));
+    EXPECT_LE(cache.size(), CACHE_SIZE);
+    EXPECT_FALSE(cache.get("b", found));
+    EXPECT_FALSE(exists(file("b")));
+    EXPECT_TRUE(cache.get("a", found));
+    EXPECT_TRUE(cache.get("c", found));
+    EXPECT_TRUE(cache.get("d", found));
+}
+
+TEST_F(TestDiskCache, keeps_expired_entries_for_revalidation) {
+    DiskCache cache(directory_, CACHE_SIZE);
+    cache.put("fresh", entry("fresh body"));
+    cache.put("stale", entry("stale body", chrono::seconds(-1)));
+
+    DiskCache::Entry found;
+    ASSERT_TRUE(cache.get("fresh", found));
+    EXPECT_TRUE(found.fresh());
+
+    // Past its TTL, an entry is still there with its validators, but no
+    // longer fresh
+    ASSERT_TRUE(cache.get("stale", found));
+    EXPECT_FALSE(found.fresh());
+    EXPECT_EQ("stale body", found.body);
+    EXPECT_EQ("\"etag\"", found.etag);
+}
+
+TEST_F(TestDiskCache, removes_entries_by_prefix) {
+    DiskCache cache(directory_, CACHE_SIZE);
+    cache.put("/me/favorites.json?limit=50", entry("first page"));
+    cache.put("/me/favorites.json?offset=49", entry("second page"));
+    cache.put("/me/followings.json", entry("followings"));
+
+    cache.remove_prefix("/me/favorites.json");
+
+    DiskCache::Entry found;
+    EXPECT_FALSE(cache.get("/me/favorites.json?limit=50", found));
+    EXPECT_FALSE(cache.get("/me/favorites.json?offset=49", found));
+    EXPECT_FALSE(exists(file("/me/favorites.json?offset=49")));
+    ASSERT_TRUE(cache.get("/me/followings.json", found));
+    EXPECT_EQ("followings", found.body);
+}
+
+}
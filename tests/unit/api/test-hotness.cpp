@@ -0,0 +1,97 @@
+
+#include <api/hotness.h>
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+static chrono::system_clock::time_point day(int year, int month, int mday) {
+    struct tm date = tm();
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = mday;
+    return chrono::system_clock::from_time_t(timegm(&date));
+}
+
+static Track track(unsigned int id, const string &created_at,
+                   unsigned int plays, unsigned int likes = 0) {
+    Json::Value data;
+    data["kind"] = "track";
+    data["id"] = id;
+    data["created_at"] = created_at + " 12:00:00 +0000";
+    data["playback_count"] = plays;
+    data["favoritings_count"] = likes;
+    return Track(data);
+}
+
+TEST(TestHotness, decays_with_age) {
+    auto now = day(2014, 12, 1);
+
+    // Same engagement, a week apart: half as hot
+    double fresh = hotness(track(1, "2014/12/01", 999), now);
+    double week_old = hotness(track(2, "2014/11/24", 999), now);
+    EXPECT_NEAR(log(2.0), fresh - week_old, 1e-9);
+
+    // Likes count for more than plays
+    EXPECT_GT(hotness(track(3, "2014/12/01", 0, 100), now),
+              hotness(track(4, "2014/12/01", 900), now));
+
+    // Unreadable dates are not held against a track
+    EXPECT_DOUBLE_EQ(fresh, hotness(track(5, "", 999), now));
+}
+
+TEST(TestHotness, picks_the_top_k) {
+    auto now = day(2014, 12, 1);
+    deque<Track> tracks {
+        track(1, "2014/01/01", 1000000),
+        track(2, "2014/11/30", 5000),
+        track(3, "2014/12/01", 10),
+        track(4, "2014/11/30", 5000),
+        track(5, "2014/11/29", 20000)
+    };
+
+    deque<Track> top = hottest(tracks, 3, now);
+    ASSERT_EQ(3u, top.size());
+    EXPECT_EQ(5u, top[0].id());
+    // Ties keep their order
+    EXPECT_EQ(2u, top[1].id());
+    EXPECT_EQ(4u, top[2].id());
+
+    EXPECT_EQ(tracks.size(), hottest(tracks, 100, now).size());
+    EXPECT_TRUE(hottest(deque<Track>(), 3, now).empty());
+}
+
+TEST(TestHotness, merges_lists_without_repeats) {
+    auto now = day(2014, 12, 1);
+    vector<deque<Track>> lists {
+        { track(1, "2014/12/01", 9000), track(2, "2014/12/01", 100) },
+        { },
+        { track(1, "2014/12/01", 9000), track(3, "2014/12/01", 5000),
+          track(4, "2014/12/01", 10) }
+    };
+
+    deque<Track> merged = merge_hottest(lists, 10, now);
+    ASSERT_EQ(4u, merged.size());
+    EXPECT_EQ(1u, merged[0].id());
+    EXPECT_EQ(3u, merged[1].id());
+    EXPECT_EQ(2u, merged[2].id());
+    EXPECT_EQ(4u, merged[3].id());
+
+    ASSERT_EQ(2u, merge_hottest(lists, 2, now).size());
+    EXPECT_TRUE(merge_hottest({ }, 2, now).empty());
+}
+
+} // namespace
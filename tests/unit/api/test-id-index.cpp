@@ -0,0 +1,93 @@
+
+#include <api/id_index.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+TEST(TestIdIndex, unknown_until_synced) {
+    IdIndex index(chrono::minutes(10), chrono::minutes(1));
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("me", 1));
+
+    ASSERT_TRUE(index.start_sync("me"));
+    // Only one sync at a time
+    EXPECT_FALSE(index.start_sync("me"));
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("me", 1));
+
+    index.synced("me", { 3, 1, 2, 3 }, true);
+    EXPECT_EQ(3u, index.size());
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 1));
+    EXPECT_EQ(IdIndex::Answer::no, index.lookup("me", 4));
+
+    // Not due again yet
+    EXPECT_FALSE(index.start_sync("me"));
+
+    // Nothing is known about anyone else
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("someone else", 1));
+}
+
+TEST(TestIdIndex, incomplete_sync_only_knows_members) {
+    IdIndex index(chrono::minutes(10), chrono::minutes(1));
+    ASSERT_TRUE(index.start_sync("me"));
+    index.synced("me", { 5 }, false);
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 5));
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("me", 6));
+}
+
+TEST(TestIdIndex, writes_survive_the_next_sync) {
+    IdIndex index(chrono::seconds(0), chrono::seconds(0));
+    ASSERT_TRUE(index.start_sync("me"));
+    index.synced("me", { 1, 2 }, true);
+
+    index.add("me", 7);
+    index.remove("me", 1);
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 7));
+    EXPECT_EQ(IdIndex::Answer::no, index.lookup("me", 1));
+
+    // A sync from before the writes does not undo them
+    ASSERT_TRUE(index.start_sync("me"));
+    index.synced("me", { 1, 2 }, true);
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 7));
+    EXPECT_EQ(IdIndex::Answer::no, index.lookup("me", 1));
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 2));
+
+    // But they are only applied once
+    ASSERT_TRUE(index.start_sync("me"));
+    index.synced("me", { 1 }, true);
+    EXPECT_EQ(IdIndex::Answer::yes, index.lookup("me", 1));
+    EXPECT_EQ(IdIndex::Answer::no, index.lookup("me", 7));
+}
+
+TEST(TestIdIndex, starts_over_for_another_user) {
+    IdIndex index(chrono::minutes(10), chrono::minutes(1));
+    ASSERT_TRUE(index.start_sync("me"));
+    index.synced("me", { 1 }, true);
+
+    ASSERT_TRUE(index.start_sync("someone else"));
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("someone else", 1));
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("me", 1));
+
+    // A late result for the previous user is dropped
+    index.synced("me", { 1 }, true);
+    EXPECT_EQ(IdIndex::Answer::unknown, index.lookup("me", 1));
+
+    // So is a late failure, the new user's sync is still running
+    index.sync_failed("me");
+    EXPECT_FALSE(index.start_sync("someone else"));
+
+    // Which then backs off
+    index.sync_failed("someone else");
+    EXPECT_FALSE(index.start_sync("someone else"));
+}
+
+} // namespace
@@ -0,0 +1,122 @@
+
+#include <api/json_stream.h>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+namespace io = boost::iostreams;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+static const string DOCUMENT = R"({
+    "kind": "track", "id": 13158665, "duration": 18935,
+    "title": "Tab \t quote \" café 🎵",
+    "streamable": true, "downloadable": false, "label_name": null,
+    "ratio": -1.5e2, "tags": [ "a", [], {}, 3 ],
+    "user": { "username": "user1", "id": 3699101 }
+})";
+
+static Json::Value parse_in_chunks(const string &text, size_t chunk) {
+    JsonValueBuilder builder;
+    JsonStreamParser parser(builder);
+    for (size_t i = 0; i < text.size(); i += chunk) {
+        parser.feed(text.data() + i, min(chunk, text.size() - i));
+    }
+    parser.finish();
+    return builder.root();
+}
+
+static string gzip(const string &text) {
+    string compressed;
+    io::filtering_ostream os;
+    os.push(io::gzip_compressor());
+    os.push(io::back_inserter(compressed));
+    os << text;
+    io::close(os);
+    return compressed;
+}
+
+TEST(TestJsonStream, matches_json_reader) {
+    Json::Value expected;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(DOCUMENT, expected));
+
+    // Every possible split point must give the same result
+    for (size_t chunk = 1; chunk <= DOCUMENT.size(); ++chunk) {
+        EXPECT_EQ(expected, parse_in_chunks(DOCUMENT, chunk)) << chunk;
+    }
+}
+
+TEST(TestJsonStream, decodes_escapes) {
+    Json::Value root = parse_in_chunks(DOCUMENT, 7);
+    EXPECT_EQ("Tab \t quote \" caf\xC3\xA9 \xF0\x9F\x8E\xB5",
+              root["title"].asString());
+    EXPECT_EQ(13158665u, root["id"].asUInt());
+    EXPECT_DOUBLE_EQ(-150.0, root["ratio"].asDouble());
+    EXPECT_TRUE(root["label_name"].isNull());
+}
+
+TEST(TestJsonStream, rejects_malformed_documents) {
+    for (const char *text : { "{\"a\" 1}", "[1,]", "{\"a\":1", "[1 2]",
+            "nul", "\"abc", "{} {}", "[\"a\\x\"]", "{1:2}" }) {
+        EXPECT_THROW(parse_in_chunks(text, 1), domain_error) << text;
+    }
+}
+
+TEST(TestJsonStream, inflates_while_parsing) {
+    string compressed = gzip(DOCUMENT);
+
+    JsonValueBuilder builder;
+    GzipJsonStream stream(builder);
+    for (size_t i = 0; i < compressed.size(); i += 16) {
+        stream.write(compressed.data() + i, min<size_t>(16, compressed.size() - i));
+    }
+    stream.close();
+
+    EXPECT_FALSE(stream.malformed());
+    EXPECT_EQ("user1", builder.root()["user"]["username"].asString());
+}
+
+TEST(TestJsonStream, reports_malformed_content) {
+    JsonValueBuilder builder;
+    GzipJsonStream stream(builder);
+    stream.write(gzip("{\"a\": [1, 2"));
+    stream.close();
+    EXPECT_TRUE(stream.malformed());
+}
+
+TEST(TestJsonStream, throws_on_corrupt_gzip) {
+    string compressed = gzip(DOCUMENT);
+    for (size_t i = 10; i < compressed.size() - 8; ++i) {
+        compressed[i] = '\xff';
+    }
+
+    JsonValueBuilder builder;
+    GzipJsonStream stream(builder);
+    EXPECT_THROW({
+        stream.write(compressed);
+        stream.close();
+    }, io::gzip_error);
+}
+
+TEST(TestJsonStream, throws_on_plain_text) {
+    JsonValueBuilder builder;
+    GzipJsonStream stream(builder);
+    EXPECT_THROW({
+        stream.write("Bad Request");
+        stream.close();
+    }, io::gzip_error);
+}
+
+} // namespace
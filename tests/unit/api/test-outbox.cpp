@@ -0,0 +1,153 @@
+
+#include <api/outbox.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+class TestOutbox: public Test {
+protected:
+    void SetUp() override
+    {
+        char directory_template[] = "/tmp/soundcloud-outbox-XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(directory_template));
+        directory_ = string(directory_template) + "/outbox";
+    }
+
+    void TearDown() override
+    {
+        system(("rm -rf '" + directory_.substr(0, directory_.rfind('/')) + "'").c_str());
+    }
+
+    static Outbox::Entry entry(Outbox::Action action, const string &target,
+                               const string &body = string()) {
+        Outbox::Entry entry;
+        entry.action = action;
+        entry.target = target;
+        entry.body = body;
+        entry.owner = "me";
+        return entry;
+    }
+
+    string directory_;
+};
+
+TEST_F(TestOutbox, sends_in_order) {
+    Outbox outbox(directory_);
+    outbox.push(entry(Outbox::Action::like, "1"));
+    outbox.push(entry(Outbox::Action::unlike, "1"));
+
+    Outbox::Entry next;
+    Outbox::Clock::time_point due;
+    ASSERT_TRUE(outbox.next(next, due));
+    EXPECT_EQ(Outbox::Action::like, next.action);
+
+    // The oldest one holds back the rest while it waits for a retry
+    outbox.retry(next.sequence, Outbox::Clock::now() + chrono::hours(1));
+    EXPECT_FALSE(outbox.next(next, due));
+    EXPECT_GT(due, Outbox::Clock::now());
+
+    outbox.retry(next.sequence, Outbox::Clock::now());
+    ASSERT_TRUE(outbox.next(next, due));
+    EXPECT_EQ(2u, next.attempts);
+    outbox.remove(next.sequence);
+
+    ASSERT_TRUE(outbox.next(next, due));
+    EXPECT_EQ(Outbox::Action::unlike, next.action);
+    outbox.remove(next.sequence);
+
+    EXPECT_FALSE(outbox.next(next, due));
+    EXPECT_EQ(Outbox::Clock::time_point::max(), due);
+}
+
+TEST_F(TestOutbox, survives_a_restart) {
+    {
+        Outbox outbox(directory_);
+        outbox.push(entry(Outbox::Action::follow, "42"));
+        outbox.push(entry(Outbox::Action::comment, "7", "Nice\nline two"));
+    }
+
+    Outbox outbox(directory_);
+    deque<Outbox::Entry> entries = outbox.entries();
+    ASSERT_EQ(2u, entries.size());
+    EXPECT_EQ(Outbox::Action::follow, entries[0].action);
+    EXPECT_EQ("42", entries[0].target);
+    EXPECT_EQ("me", entries[0].owner);
+    EXPECT_EQ(Outbox::Action::comment, entries[1].action);
+    EXPECT_EQ("Nice\nline two", entries[1].body);
+
+    // New entries go after the old ones
+    Outbox::Entry pushed = outbox.push(entry(Outbox::Action::unfollow, "42"));
+    EXPECT_GT(pushed.sequence, entries[1].sequence);
+
+    outbox.remove(entries[0].sequence);
+    EXPECT_EQ(2u, Outbox(directory_).entries().size());
+}
+
+TEST_F(TestOutbox, drops_corrupt_entries) {
+    {
+        Outbox outbox(directory_);
+        outbox.push(entry(Outbox::Action::comment, "7", "Hello"));
+    }
+    Outbox::Entry stored = Outbox(directory_).entries().front();
+
+    char name[21];
+    snprintf(name, sizeof(name), "%020llu", (unsigned long long) stored.sequence);
+    {
+        ofstream out(directory_ + "/" + name, ios::app);
+        out << "garbage";
+    }
+    ofstream(directory_ + "/00000000000000000009.tmp") << "half written";
+
+    EXPECT_TRUE(Outbox(directory_).entries().empty());
+}
+
+TEST_F(TestOutbox, newest_write_decides_the_state) {
+    Outbox outbox("");
+    bool present = false;
+    EXPECT_FALSE(outbox.state("me", "1", Outbox::Action::like,
+                              Outbox::Action::unlike, present));
+
+    outbox.push(entry(Outbox::Action::like, "1"));
+    outbox.push(entry(Outbox::Action::follow, "1"));
+    ASSERT_TRUE(outbox.state("me", "1", Outbox::Action::like,
+                             Outbox::Action::unlike, present));
+    EXPECT_TRUE(present);
+
+    outbox.push(entry(Outbox::Action::unlike, "1"));
+    ASSERT_TRUE(outbox.state("me", "1", Outbox::Action::like,
+                             Outbox::Action::unlike, present));
+    EXPECT_FALSE(present);
+
+    // Only for the user who made them
+    EXPECT_FALSE(outbox.state("someone else", "1", Outbox::Action::like,
+                              Outbox::Action::unlike, present));
+}
+
+TEST_F(TestOutbox, knows_what_is_queued) {
+    Outbox outbox("");
+    EXPECT_FALSE(outbox.queued("me", "7", Outbox::Action::comment));
+
+    Outbox::Entry pushed = outbox.push(entry(Outbox::Action::comment, "7", "Hi"));
+    EXPECT_TRUE(outbox.queued("me", "7", Outbox::Action::comment));
+    EXPECT_FALSE(outbox.queued("me", "8", Outbox::Action::comment));
+    EXPECT_FALSE(outbox.queued("me", "7", Outbox::Action::like));
+    EXPECT_FALSE(outbox.queued("someone else", "7", Outbox::Action::comment));
+
+    outbox.remove(pushed.sequence);
+    EXPECT_FALSE(outbox.queued("me", "7", Outbox::Action::comment));
+}
+
+} // namespace
@@ -0,0 +1,135 @@
+#include <api/result_cache.h>
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <chrono>
+#include <deque>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+
+namespace json = Json;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+static const chrono::hours TTL(1);
+
+/**
+ * What an entry of @a items under a one-character key takes up
+ */
+static size_t item_bytes(const deque<bool> &items) {
+    return 1 + approximate_size(items);
+}
+
+TEST(TestResultCache, sizes_values_by_their_contents) {
+    deque<bool> flags(100, true);
+    EXPECT_EQ(sizeof(flags) + 100 * sizeof(bool), approximate_size(flags));
+
+    json::Value data;
+    data["title"] = "Short";
+    Track short_title(data);
+    data["title"] = string(1000, 'x');
+    Track long_title(data);
+    EXPECT_GE(approximate_size(long_title),
+              approximate_size(short_title) + 1000
+                      - short_title.title().capacity());
+
+    deque<Track> tracks { short_title, long_title };
+    EXPECT_EQ(sizeof(tracks) + approximate_size(short_title)
+                      + approximate_size(long_title),
+              approximate_size(tracks));
+}
+
+TEST(TestResultCache, evicts_least_recently_used_by_size) {
+    deque<bool> value(100, true);
+    size_t bytes = item_bytes(value);
+
+    // Room for two and a half
+    ResultCache cache(2 * bytes + bytes / 2);
+    cache.put("a", value, TTL);
+    cache.put("b", value, TTL);
+    EXPECT_EQ(2 * bytes, cache.statistics().bytes);
+
+    // Using a makes b the oldest
+    EXPECT_TRUE(bool(cache.get<deque<bool>>("a")));
+    cache.put("c", value, TTL);
+    EXPECT_EQ(2u, cache.statistics().entries);
+    EXPECT_EQ(2 * bytes, cache.statistics().bytes);
+    EXPECT_FALSE(bool(cache.get<deque<bool>>("b")));
+    EXPECT_TRUE(bool(cache.get<deque<bool>>("a")));
+    EXPECT_TRUE(bool(cache.get<deque<bool>>("c")));
+
+    // A larger value pushes out as many as it needs
+    cache.put("d", deque<bool>(bytes + 100, true), TTL);
+    EXPECT_EQ(1u, cache.statistics().entries);
+    EXPECT_TRUE(bool(cache.get<deque<bool>>("d")));
+
+    // One that could never fit is not kept, and takes nothing with it
+    cache.put("e", deque<bool>(3 * bytes, true), TTL);
+    EXPECT_FALSE(bool(cache.get<deque<bool>>("e")));
+    EXPECT_TRUE(bool(cache.get<deque<bool>>("d")));
+}
+
+TEST(TestResultCache, misses_lookups_of_another_type) {
+    ResultCache cache(1024);
+    cache.put("flag", true, TTL);
+
+    EXPECT_FALSE(bool(cache.get<deque<bool>>("flag")));
+    auto flag = cache.get<bool>("flag");
+    ASSERT_TRUE(bool(flag));
+    EXPECT_TRUE(*flag);
+
+    // Putting another type under the key replaces the entry
+    cache.put("flag", deque<bool>(3, false), TTL);
+    EXPECT_EQ(1u, cache.statistics().entries);
+    EXPECT_FALSE(bool(cache.get<bool>("flag")));
+    auto flags = cache.get<deque<bool>>("flag");
+    ASSERT_TRUE(bool(flags));
+    EXPECT_EQ(3u, flags->size());
+}
+
+TEST(TestResultCache, counts_hits_and_misses) {
+    ResultCache cache(1024);
+    cache.put("fresh", true, TTL);
+    cache.put("stale", true, chrono::seconds(-1));
+
+    EXPECT_TRUE(bool(cache.get<bool>("fresh")));
+    EXPECT_FALSE(bool(cache.get<bool>("missing")));
+    EXPECT_FALSE(bool(cache.get<deque<bool>>("fresh")));
+
+    // Expired entries only count as hits when asked for
+    EXPECT_FALSE(bool(cache.get<bool>("stale")));
+    EXPECT_TRUE(bool(cache.get<bool>("stale", true)));
+
+    ResultCache::Statistics statistics = cache.statistics();
+    EXPECT_EQ(2u, statistics.hits);
+    EXPECT_EQ(3u, statistics.misses);
+    EXPECT_EQ(2u, statistics.entries);
+
+    cache.clear();
+    statistics = cache.statistics();
+    EXPECT_EQ(0u, statistics.entries);
+    EXPECT_EQ(0u, statistics.bytes);
+    EXPECT_EQ(2u, statistics.hits);
+}
+
+TEST(TestResultCache, removes_entries_by_prefix) {
+    ResultCache cache(1024);
+    cache.put("/me/favorites.json?limit=50|", true, TTL);
+    cache.put("/me/favorites.json?limit=50|page", true, TTL);
+    cache.put("/me/followings.json|", true, TTL);
+
+    cache.remove_prefix("/me/favorites.json");
+
+    EXPECT_FALSE(bool(cache.get<bool>("/me/favorites.json?limit=50|")));
+    EXPECT_FALSE(bool(cache.get<bool>("/me/favorites.json?limit=50|page")));
+    EXPECT_TRUE(bool(cache.get<bool>("/me/followings.json|")));
+    EXPECT_EQ(1u, cache.statistics().entries);
+}
+
+}
@@ -0,0 +1,112 @@
+#include <scope/preview_cache.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace scope;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+static PreviewCache::Entry entry(const string &owner, bool liked = false,
+                                 const string &userid = "42") {
+    PreviewCache::Entry entry;
+    entry.owner = owner;
+    entry.userid = userid;
+    entry.liked = liked;
+    return entry;
+}
+
+TEST(TestPreviewCache, drops_the_least_recently_used) {
+    PreviewCache cache(2, chrono::minutes(10));
+    cache.put("1", entry("me"));
+    cache.put("2", entry("me"));
+
+    PreviewCache::Entry found;
+    ASSERT_TRUE(cache.get("1", "me", found));
+    cache.put("3", entry("me"));
+    EXPECT_EQ(2u, cache.size());
+
+    EXPECT_TRUE(cache.get("1", "me", found));
+    EXPECT_FALSE(cache.get("2", "me", found));
+    EXPECT_TRUE(cache.get("3", "me", found));
+
+    // Replacing an entry does not make room for another
+    cache.put("3", entry("me", true));
+    EXPECT_EQ(2u, cache.size());
+    ASSERT_TRUE(cache.get("3", "me", found));
+    EXPECT_TRUE(found.liked);
+}
+
+TEST(TestPreviewCache, only_for_the_same_user) {
+    PreviewCache cache(2, chrono::minutes(10));
+    cache.put("1", entry("me", true));
+
+    PreviewCache::Entry found;
+    EXPECT_FALSE(cache.get("1", "someone else", found));
+    EXPECT_FALSE(cache.get("1", "", found));
+    ASSERT_TRUE(cache.get("1", "me", found));
+    EXPECT_EQ("42", found.userid);
+}
+
+TEST(TestPreviewCache, expires) {
+    PreviewCache cache(2, chrono::seconds(0));
+    cache.put("1", entry("me"));
+
+    PreviewCache::Entry found;
+    EXPECT_FALSE(cache.get("1", "me", found));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(TestPreviewCache, applies_the_users_writes) {
+    PreviewCache cache(4, chrono::minutes(10));
+    cache.put("1", entry("me", false, "42"));
+    cache.put("2", entry("me", false, "42"));
+    cache.put("3", entry("me", false, "7"));
+    cache.put("4", entry("someone else", false, "42"));
+
+    PreviewCache::Entry found;
+    cache.set_liked("me", "1", true);
+    ASSERT_TRUE(cache.get("1", "me", found));
+    EXPECT_TRUE(found.liked);
+    ASSERT_TRUE(cache.get("2", "me", found));
+    EXPECT_FALSE(found.liked);
+
+    // Every track of the author, and only theirs
+    cache.set_following("me", "42", true);
+    ASSERT_TRUE(cache.get("1", "me", found));
+    EXPECT_TRUE(found.following);
+    ASSERT_TRUE(cache.get("2", "me", found));
+    EXPECT_TRUE(found.following);
+    ASSERT_TRUE(cache.get("3", "me", found));
+    EXPECT_FALSE(found.following);
+
+    // Not for anyone else
+    ASSERT_TRUE(cache.get("4", "someone else", found));
+    EXPECT_FALSE(found.following);
+
+    cache.erase("2");
+    EXPECT_FALSE(cache.get("2", "me", found));
+    EXPECT_TRUE(cache.get("1", "me", found));
+}
+
+TEST(TestPreviewCache, drops_what_was_fetched_before_a_write) {
+    PreviewCache cache(2, chrono::minutes(10));
+    uint64_t writes = cache.writes();
+    cache.set_liked("me", "1", true);
+
+    // Fetched while the like was being made
+    cache.put("1", entry("me", false), writes);
+    PreviewCache::Entry found;
+    EXPECT_FALSE(cache.get("1", "me", found));
+
+    cache.put("1", entry("me", true), cache.writes());
+    EXPECT_TRUE(cache.get("1", "me", found));
+}
+
+} // namespace
@@ -0,0 +1,101 @@
+#include <scope/snapshot.h>
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace testing;
+using namespace scope;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+class TestSnapshot: public Test {
+protected:
+    void SetUp() override
+    {
+        char directory_template[] = "/tmp/soundcloud-snapshot-XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(directory_template));
+        directory_ = directory_template;
+        file_ = directory_ + "/snapshot";
+    }
+
+    void TearDown() override
+    {
+        system(("rm -rf '" + directory_ + "'").c_str());
+    }
+
+    static Snapshot::Item item(const string &category, const string &key,
+                               const string &result = string()) {
+        Snapshot::Item item;
+        item.category = category;
+        item.key = key;
+        item.result = result;
+        return item;
+    }
+
+    string directory_;
+
+    string file_;
+};
+
+TEST_F(TestSnapshot, survives_a_restart) {
+    {
+        Snapshot snapshot(file_, nullptr);
+        snapshot.put("me", { item("user", "u"), item("stream", "a\nb", "{\"x\":1}") },
+                     false);
+    }
+
+    Snapshot snapshot(file_, nullptr);
+    vector<Snapshot::Item> items;
+    ASSERT_TRUE(snapshot.get("me", items));
+    ASSERT_EQ(2u, items.size());
+    EXPECT_EQ("user", items[0].category);
+    EXPECT_EQ("a\nb", items[1].key);
+    EXPECT_EQ("{\"x\":1}", items[1].result);
+
+    // Only for the user it was taken for
+    EXPECT_FALSE(snapshot.get("someone else", items));
+}
+
+TEST_F(TestSnapshot, signals_only_changes_that_were_shown) {
+    unsigned int changes = 0;
+    Snapshot snapshot(file_, [&changes] { ++changes; });
+
+    // Nothing was there to be shown
+    EXPECT_FALSE(snapshot.put("me", { item("explore", "1") }, true));
+
+    // Fresher counters are stored, but the page looks the same
+    EXPECT_FALSE(snapshot.put("me", { item("explore", "1", "new") }, true));
+    vector<Snapshot::Item> items;
+    ASSERT_TRUE(snapshot.get("me", items));
+    EXPECT_EQ("new", items[0].result);
+
+    // Not shown, so there is nothing to take back
+    EXPECT_FALSE(snapshot.put("me", { item("explore", "2") }, false));
+    EXPECT_EQ(0u, changes);
+
+    EXPECT_TRUE(snapshot.put("me", { item("explore", "2"), item("explore", "3") },
+                             true));
+    EXPECT_EQ(1u, changes);
+}
+
+TEST_F(TestSnapshot, drops_a_corrupt_file) {
+    {
+        Snapshot snapshot(file_, nullptr);
+        snapshot.put("me", { item("explore", "1") }, false);
+    }
+    {
+        ofstream out(file_, ios::app);
+        out << "garbage";
+    }
+    vector<Snapshot::Item> items;
+    EXPECT_FALSE(Snapshot(file_, nullptr).get("me", items));
+}
+
+} // namespace
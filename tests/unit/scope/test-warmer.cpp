@@ -0,0 +1,78 @@
+#include <scope/warmer.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+using namespace scope;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+class TestWarmer: public Test {
+protected:
+    void SetUp() override
+    {
+        setenv("SOUNDCLOUD_SCOPE_IGNORE_ACCOUNTS", "true", true);
+
+        char cache_template[] = "/tmp/soundcloud-warmer-XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(cache_template));
+        cache_directory_ = cache_template;
+    }
+
+    void TearDown() override
+    {
+        system(("rm -rf '" + cache_directory_ + "'").c_str());
+    }
+
+    /**
+     * A warmer that does not get round to warming anything
+     */
+    Warmer::Ptr idle_warmer(const Client &client) {
+        return make_shared<Warmer>(client, vector<string>(),
+                                   cache_directory_ + "/departments", 2,
+                                   chrono::hours(1), chrono::hours(1),
+                                   chrono::milliseconds(0),
+                                   chrono::seconds(1));
+    }
+
+    string read_uses() {
+        ifstream in(cache_directory_ + "/departments");
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    string cache_directory_;
+};
+
+TEST_F(TestWarmer, remembers_department_uses) {
+    Client client(nullptr, cache_directory_);
+    {
+        Warmer::Ptr warmer = idle_warmer(client);
+        warmer->used("rock");
+        warmer->used("rock");
+        warmer->used("jazz");
+
+        // Does not wait for the first round
+        auto start = chrono::steady_clock::now();
+        warmer->stop();
+        EXPECT_LT(chrono::steady_clock::now() - start, chrono::seconds(1));
+    }
+    EXPECT_EQ("1\tjazz\n2\trock\n", read_uses());
+
+    Warmer::Ptr warmer = idle_warmer(client);
+    warmer->used("rock");
+    // A query outliving the warmer is harmless
+    shared_ptr<void> busy = warmer->busy();
+    warmer->stop();
+    EXPECT_EQ("1\tjazz\n3\trock\n", read_uses());
+}
+
+} // namespace